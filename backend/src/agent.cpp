@@ -1,5 +1,6 @@
 #include "agent.hpp"
 #include "json_util.hpp"
+#include <algorithm>
 #include <cmath>
 #include <condition_variable>
 #include <curl/curl.h>
@@ -14,9 +15,14 @@
 
 #include "agent/loop.hpp"
 #include "agent/session.hpp"
+#include "agent/sse_parser.hpp"
 #include "tools/tool.hpp"
+#include "agent/base64_floats.hpp"
 #include "agent/curl_manager.hpp"
+#include "agent/embed_batcher.hpp"
+#include "agent/embedding_cache.hpp"
 #include "agent/fiber_pool.hpp"
+#include "agent/static_embedder.hpp"
 #include "agent/subagent.hpp"
 #include "config.hpp"
 #include "tools/file.hpp"
@@ -60,6 +66,27 @@ Agent::Agent() {
   model_ = Config::instance().conversation_model();
   workspace_ = Config::instance().memory_workspace();
 
+  // In-process embeddings from a static token table; no cache or batching
+  // needed. If the model fails to load, memory search runs on keywords alone
+  // rather than mixing in vectors from another model.
+  if (Config::instance().embedding_provider() == "static") {
+    std::filesystem::path model = Config::instance().embedding_static_model();
+    if (model.is_relative())
+      model = std::filesystem::path(workspace_) / model;
+    static_embedder_ = std::make_unique<StaticEmbedder>();
+    if (!static_embedder_->load(model, Config::instance().embedding_dimension()))
+      spdlog::error("Static embeddings unavailable; memory search will use "
+                    "keywords only");
+  } else if (Config::instance().embedding_cache_max_mb() > 0) {
+    // Embeddings by content, so a text embedded before costs a lookup.
+    embed_cache_ = std::make_unique<EmbeddingCache>(
+        std::filesystem::path(workspace_) / "cache" / "embeddings.bin",
+        Config::instance().embedding_model(),
+        Config::instance().embedding_dimension(),
+        (size_t)std::max(Config::instance().embedding_cache_entries(), 0),
+        (uint64_t)Config::instance().embedding_cache_max_mb() << 20);
+  }
+
   // Build the LLM call function (now takes model, endpoint and provider too)
   LLMCallFn llm_fn =
       [this](const std::vector<Message> &messages,
@@ -102,7 +129,19 @@ Agent::Agent() {
              "\"description\":\"Search through "
              "memory using hybrid search.\",\"parameters\":{\"type\":\"object\",\"properties\":{"
              "\"query\":{\"type\":\"string\",\"description\":\"The search "
-             "query.\"}},\"required\":[\"query\"]}}}";
+             "query.\"},"
+             "\"sources\":{\"type\":\"array\",\"items\":{\"type\":\"string\","
+             "\"enum\":[\"sessions\",\"memory\",\"long-term\"]},\"description\":"
+             "\"Only search these tiers: sessions (conversation messages), memory "
+             "(daily logs), long-term (curated facts).\"},"
+             "\"session\":{\"type\":\"string\",\"description\":\"Only search "
+             "messages from this session key, or 'current' for this conversation.\"},"
+             "\"path_prefix\":{\"type\":\"string\",\"description\":\"Only "
+             "search documents whose path starts with this.\"},"
+             "\"since\":{\"type\":\"string\",\"description\":\"Earliest date, "
+             "YYYY-MM-DD.\"},"
+             "\"until\":{\"type\":\"string\",\"description\":\"Latest date, "
+             "YYYY-MM-DD.\"}},\"required\":[\"query\"]}}}";
     }
     std::string execute(const std::map<std::string, std::string> &) override {
       return "";
@@ -114,14 +153,15 @@ Agent::Agent() {
     std::string name() const override { return "index_document"; }
     std::string description() const override {
       return "Add a document to the agent's memory index for later retrieval. "
-             "Requires a path and the full text content.";
+             "Requires a path; the text is read from that file if omitted.";
     }
     std::string schema() const override {
       return "{\"type\":\"function\",\"function\":{\"name\":\"index_document\","
-             "\"description\":\"Index a document.\",\"parameters\":{\"type\":\"object\",\"properties\":{"
+             "\"description\":\"Index a document for memory_search. Large documents are split into line-ranged chunks; "
+             "re-indexing a path replaces its previous chunks.\",\"parameters\":{\"type\":\"object\",\"properties\":{"
              "\"path\":{\"type\":\"string\",\"description\":\"The document path.\"},"
-             "\"text\":{\"type\":\"string\",\"description\":\"The content to index.\"}},"
-             "\"required\":[\"path\",\"text\"]}}}";
+             "\"text\":{\"type\":\"string\",\"description\":\"The content to index. Omit to read the file at path.\"}},"
+             "\"required\":[\"path\"]}}}";
     }
     std::string execute(const std::map<std::string, std::string> &) override {
       return "";
@@ -160,6 +200,10 @@ void Agent::run(const std::string &user_message, const std::string &session_id,
 AgentLoop& Agent::loop() { return *loop_; }
 SessionManager& Agent::sessions() { return *sessions_; }
 
+void Agent::reembed_memory() { loop_->context().memory().reembed(); }
+
+void Agent::flush_memory() { loop_->context().memory().flush_session_index(); }
+
 // ─── Serialize a Message vector to JSON ──────────────────────────────────────
 
 static std::string serialize_messages(const std::vector<Message> &messages) {
@@ -204,46 +248,90 @@ struct ToolCallAccum {
 
 // ─── call_llm: sends messages + tools, parses streaming tool_calls ───────────
 
+// ─── embed: batched across the fibers of this node ───────────────────────────
+
 std::vector<float> Agent::embed(const std::string &text) {
+  if (static_embedder_)
+    return static_embedder_->embed(text);
+
+  // Batches never mix API keys; a fiber may carry its own (localdata slot 1).
+  std::string effective_key = api_key_;
+  auto *fiber_tcb = fiber_ident();
+  if (fiber_tcb) {
+    auto *key_ptr =
+        reinterpret_cast<std::string *>(fiber_get_localdata(fiber_tcb, 1));
+    if (key_ptr && !key_ptr->empty())
+      effective_key = *key_ptr;
+  }
+
+  std::vector<float> embedding;
+  if (embed_cache_ && embed_cache_->get(text, embedding))
+    return embedding;
+
+  embedding = EmbedBatcher::instance().embed(
+      effective_key, text,
+      [this, &effective_key](const std::vector<std::string> &texts) {
+        return embed_batch(texts, effective_key);
+      },
+      (size_t)std::max(Config::instance().embedding_batch_max(), 1),
+      Config::instance().embedding_batch_window_ms());
+  if (embed_cache_)
+    embed_cache_->put(text, embedding);
+  return embedding;
+}
+
+// One /embeddings request for all of `texts` (an array input), returning a
+// vector per text in order; a text the response does not cover stays empty.
+std::vector<std::vector<float>>
+Agent::embed_batch(const std::vector<std::string> &texts,
+                   const std::string &effective_key) {
   std::string provider = Config::instance().embedding_provider();
   std::string model = Config::instance().embedding_model();
   std::string endpoint = Config::instance().embedding_endpoint();
 
   // Log the endpoint for debugging local providers
-  spdlog::debug("Embedding using provider: {}, model: {}, endpoint: {}",
-                provider, model, endpoint);
+  spdlog::debug("Embedding {} texts using provider: {}, model: {}, endpoint: {}",
+                texts.size(), provider, model, endpoint);
 
   struct CallData {
     std::string buffer;
     fiber_t fiber;
     std::function<void(CURLcode)> completion_cb;
     struct curl_slist *headers = nullptr;
-    std::vector<float> embedding;
+    std::vector<std::vector<float>> embeddings;
   };
 
   auto *data = new CallData();
   data->fiber = fiber_ident();
-  CURL *easy = curl_easy_init();
+  data->embeddings.resize(texts.size());
 
   // SAFETY: completion_cb is called by CurlMultiManager, which is thread_local
   // and attached to the owning FiberNode's loop. Thus fiber_resume runs on the correct thread.
-  data->completion_cb = [data, easy](CURLcode) { fiber_resume(data->fiber); };
-
-  std::string payload = "{\"model\":\"" + model + "\",\"input\":\"" +
-                        json_util::escape(text) + "\"}";
+  data->completion_cb = [data](CURLcode) { fiber_resume(data->fiber); };
+
+  // A single text is sent as a plain string, as before batching.
+  std::string input;
+  if (texts.size() == 1) {
+    input = "\"" + json_util::escape(texts[0]) + "\"";
+  } else {
+    input = "[";
+    for (size_t i = 0; i < texts.size(); ++i) {
+      if (i > 0)
+        input += ",";
+      input += "\"" + json_util::escape(texts[i]) + "\"";
+    }
+    input += "]";
+  }
+  std::string payload = "{\"model\":\"" + model + "\",\"input\":" + input;
+  // Only sent when asked for: strict servers reject fields they do not know.
+  std::string encoding = Config::instance().embedding_encoding_format();
+  if (encoding != "float")
+    payload += ",\"encoding_format\":\"" + json_util::escape(encoding) + "\"";
+  payload += "}";
 
   data->headers =
       curl_slist_append(data->headers, "Content-Type: application/json");
 
-  std::string effective_key = api_key_;
-  auto *fiber_tcb = fiber_ident();
-  if (fiber_tcb) {
-    auto *key_ptr =
-        reinterpret_cast<std::string *>(fiber_get_localdata(fiber_tcb, 1));
-    if (key_ptr && !key_ptr->empty())
-      effective_key = *key_ptr;
-  }
-
   // Auth header only for OpenAI (or similar)
   if (provider == "openai" || !api_key_.empty()) {
     std::string auth = "Authorization: Bearer " + effective_key;
@@ -265,7 +353,7 @@ std::vector<float> Agent::embed(const std::string &text) {
     }
   }
 
-  curl_easy_setopt(easy, CURLOPT_URL, effective_endpoint.c_str());
+  CURL *easy = CurlMultiManager::instance().acquire(effective_endpoint);
   curl_easy_setopt(easy, CURLOPT_COPYPOSTFIELDS, payload.c_str());
   curl_easy_setopt(easy, CURLOPT_HTTPHEADER, data->headers);
   curl_easy_setopt(easy, CURLOPT_PRIVATE, &data->completion_cb);
@@ -283,20 +371,66 @@ std::vector<float> Agent::embed(const std::string &text) {
   CurlMultiManager::instance().remove_handle(easy);
 
   // Parse result (assuming OpenAI-compatible structure for both local and
-  // remote)
+  // remote). Each item names the input it belongs to in "index"; its
+  // embedding is a base64 string or, from servers that ignore
+  // encoding_format, a decimal array. Either way only the first target_dim
+  // values are read (MRL truncation), summing squares as they land, and a
+  // truncated vector is then L2-normalized.
+  int target_dim = Config::instance().embedding_dimension();
   try {
     simdjson::dom::parser parser;
     simdjson::dom::element j;
     auto padded = simdjson::padded_string(data->buffer);
     if (!parser.parse(padded).get(j)) {
       simdjson::dom::array data_arr;
-      if (!j["data"].get(data_arr) && data_arr.size() > 0) {
-        simdjson::dom::array emb_arr;
-        if (!data_arr.at(0)["embedding"].get(emb_arr)) {
-          for (auto val : emb_arr) {
-            double d;
-            if (!val.get(d))
-              data->embedding.push_back((float)d);
+      if (!j["data"].get(data_arr)) {
+        size_t position = 0;
+        for (auto item : data_arr) {
+          uint64_t index = position++;
+          uint64_t given;
+          if (!item["index"].get(given))
+            index = given;
+          if (index >= data->embeddings.size())
+            continue;
+          auto &embedding = data->embeddings[index];
+          std::string_view packed;
+          simdjson::dom::array emb_arr;
+          size_t full = 0;
+          double sum_sq = 0;
+          if (!item["embedding"].get(packed)) {
+            full = base64_float_count(packed);
+            embedding.resize(std::min(full, (size_t)target_dim));
+            if (decode_base64_floats(packed, embedding.data(), embedding.size(),
+                                     sum_sq) != embedding.size()) {
+              spdlog::warn("Malformed base64 embedding in response");
+              embedding.clear();
+              continue;
+            }
+          } else if (!item["embedding"].get(emb_arr)) {
+            full = emb_arr.size();
+            embedding.reserve(std::min(full, (size_t)target_dim));
+            for (auto val : emb_arr) {
+              if (embedding.size() == (size_t)target_dim)
+                break;
+              double d;
+              if (!val.get(d)) {
+                embedding.push_back((float)d);
+                sum_sq += d * d;
+              }
+            }
+          } else {
+            continue;
+          }
+
+          if (full <= (size_t)target_dim)
+            continue;
+          spdlog::debug("MRL Truncating embedding from {} to {}", full,
+                        target_dim);
+          float norm = (float)std::sqrt(sum_sq);
+          if (norm > 1e-9f) {
+            float inv = 1.0f / norm;
+            for (float &v : embedding)
+              v *= inv;
           }
         }
       }
@@ -304,30 +438,27 @@ std::vector<float> Agent::embed(const std::string &text) {
   } catch (...) {
   }
 
-  // 3. MRL Truncation & L2 Normalization
-  int target_dim = Config::instance().embedding_dimension();
-  if (data->embedding.size() > (size_t)target_dim) {
-    spdlog::debug("MRL Truncating embedding from {} to {}",
-                  data->embedding.size(), target_dim);
-    data->embedding.resize(target_dim);
-
-    double sum_sq = 0;
-    for (float v : data->embedding)
-      sum_sq += (double)v * v;
-    float norm = (float)std::sqrt(sum_sq);
-    if (norm > 1e-9f) {
-      for (float &v : data->embedding)
-        v /= norm;
-    }
-  }
-
-  std::vector<float> result = data->embedding;
+  std::vector<std::vector<float>> result = std::move(data->embeddings);
   curl_slist_free_all(data->headers);
-  curl_easy_cleanup(easy);
+  CurlMultiManager::instance().release(effective_endpoint, easy);
   delete data;
   return result;
 }
 
+// An {"error": {...}} body from the provider: report its message as the reply.
+static void set_llm_error(std::string_view body, std::string &text) {
+  simdjson::dom::parser parser;
+  simdjson::dom::element j, err;
+  auto padded = simdjson::padded_string(body);
+  if (parser.parse(padded).get(j) || j["error"].get(err))
+    return;
+  std::string_view msg;
+  if (!err["message"].get(msg))
+    text = "Error: " + std::string(msg);
+  else
+    text = "Error: " + simdjson::to_string(err);
+}
+
 LLMResponse Agent::call_llm(const std::vector<Message> &messages,
                             const std::string &tools_json,
                             AgentEventCallback on_event,
@@ -339,11 +470,14 @@ LLMResponse Agent::call_llm(const std::vector<Message> &messages,
     Agent *self;
     AgentEventCallback on_event;
     std::string text_content; // accumulates delta.content tokens
-    std::string buffer;       // raw SSE buffer
+    std::string raw;          // body before the first event (an error response)
+    bool streamed = false;    // an event has arrived
+    std::unique_ptr<SseParser> sse;
     fiber_t fiber;
     std::function<void(CURLcode)> completion_cb;
     struct curl_slist *headers = nullptr;
-    simdjson::dom::parser parser;
+    CURL *easy = nullptr;
+    simdjson::ondemand::parser parser;
 
     // tool_calls accumulation
     std::vector<ToolCallAccum> tool_calls;
@@ -353,14 +487,13 @@ LLMResponse Agent::call_llm(const std::vector<Message> &messages,
   data->self = this;
   data->on_event = on_event;
   data->fiber = fiber_ident();
-  CURL *easy = curl_easy_init();
 
-  data->completion_cb = [data, easy](CURLcode code) {
+  data->completion_cb = [data](CURLcode code) {
     if (code != CURLE_OK) {
       spdlog::error("CURL error: {}", curl_easy_strerror(code));
     }
     long http_code = 0;
-    curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_easy_getinfo(data->easy, CURLINFO_RESPONSE_CODE, &http_code);
     if (http_code >= 400) {
       spdlog::error("LLM HTTP Error: {}", http_code);
       if (data->text_content.empty()) {
@@ -417,111 +550,126 @@ LLMResponse Agent::call_llm(const std::vector<Message> &messages,
   }
   spdlog::info("LLM URL: {} Model: {}", effective_endpoint, effective_model);
 
-  curl_easy_setopt(easy, CURLOPT_URL, effective_endpoint.c_str());
+  CURL *easy = CurlMultiManager::instance().acquire(effective_endpoint);
+  data->easy = easy;
   curl_easy_setopt(easy, CURLOPT_COPYPOSTFIELDS, payload_str.c_str());
   curl_easy_setopt(easy, CURLOPT_HTTPHEADER, data->headers);
   curl_easy_setopt(easy, CURLOPT_PRIVATE, &data->completion_cb);
 
-  // ── Write callback: parse SSE stream ───────────────────────────────────
-  auto write_cb = [](char *ptr, size_t size, size_t nmemb,
-                     void *userdata) -> size_t {
-    size_t total = size * nmemb;
-    auto *d = (CallData *)userdata;
-    d->buffer.append(ptr, total);
-
-    size_t pos;
-    while ((pos = d->buffer.find('\n')) != std::string::npos) {
-      std::string line = d->buffer.substr(0, pos);
-      d->buffer.erase(0, pos + 1);
-
-      // Strip carriage return
-      if (!line.empty() && line.back() == '\r')
-        line.pop_back();
-
-      if (line.rfind("data: ", 0) != 0) {
-        // Non-data line: might be an error JSON
-        if (!line.empty()) {
-          spdlog::debug("LLM raw line: {}", line);
-          simdjson::dom::element j;
-          auto padded = simdjson::padded_string(line);
-          if (!d->parser.parse(padded).get(j)) {
-            simdjson::dom::element err;
-            if (!j["error"].get(err)) {
-              std::string_view msg;
-              if (!err["message"].get(msg))
-                d->text_content = "Error: " + std::string(msg);
-              else
-                d->text_content = "Error: " + simdjson::to_string(err);
-            }
+  // ── SSE events: each chunk is parsed in place with simdjson on-demand ──
+  data->sse = std::make_unique<SseParser>([data](std::string_view type,
+                                                 std::string_view payload) {
+    data->streamed = true;
+    if (payload.empty() || payload == "[DONE]")
+      return;
+    if (type != "message" && type != "error")
+      return;
+
+    simdjson::ondemand::document doc;
+    simdjson::ondemand::object obj;
+    simdjson::padded_string_view view(payload.data(), payload.size(),
+                                      payload.size() + simdjson::SIMDJSON_PADDING);
+    if (data->parser.iterate(view).get(doc) || doc.get_object().get(obj)) {
+      spdlog::warn("simdjson parse error in write_cb: {}",
+                   payload.substr(0, 200));
+      return;
+    }
+
+    simdjson::ondemand::array choices;
+    if (obj["choices"].get(choices)) {
+      set_llm_error(payload, data->text_content); // {"error": ...} mid-stream
+      return;
+    }
+    for (auto choice : choices) {
+      simdjson::ondemand::object delta;
+      if (choice["delta"].get(delta))
+        return;
+      // Fields in document order, the on-demand way.
+      for (auto field : delta) {
+        std::string_view key;
+        if (field.unescaped_key().get(key))
+          return;
+
+        // ── Text content tokens ────────────────────────────────────────
+        if (key == "content") {
+          std::string_view content_sv;
+          if (!field.value().get_string().get(content_sv) &&
+              !content_sv.empty()) {
+            std::string tok(content_sv);
+            data->on_event({"token", tok});
+            data->text_content += tok;
           }
+          continue;
         }
-        continue;
-      }
-
-      std::string json_str = line.substr(6);
-      if (json_str == "[DONE]" || json_str.empty())
-        continue;
-
-      simdjson::dom::element j;
-      auto padded = simdjson::padded_string(json_str);
-      auto error = d->parser.parse(padded).get(j);
-      if (error) {
-        spdlog::warn("simdjson parse error in write_cb: {}",
-                     json_str.substr(0, 200));
-        continue;
-      }
-
-      simdjson::dom::array choices;
-      if (j["choices"].get(choices) || choices.size() == 0)
-        continue;
-
-      simdjson::dom::element delta;
-      if (choices.at(0)["delta"].get(delta))
-        continue;
 
-      // ── Text content tokens ────────────────────────────────────────
-      std::string_view content_sv;
-      if (!delta["content"].get(content_sv) && !content_sv.empty()) {
-        std::string tok(content_sv);
-        d->on_event({"token", tok});
-        d->text_content += tok;
-      }
-
-      // ── Tool call chunks ───────────────────────────────────────────
-      simdjson::dom::array tc_arr;
-      if (!delta["tool_calls"].get(tc_arr)) {
+        // ── Tool call chunks ───────────────────────────────────────────
+        simdjson::ondemand::array tc_arr;
+        if (key != "tool_calls" || field.value().get_array().get(tc_arr))
+          continue;
         for (auto tc_elem : tc_arr) {
-          int64_t idx = 0;
-          if (tc_elem["index"].get(idx)) {
+          simdjson::ondemand::object tc;
+          if (tc_elem.get_object().get(tc))
+            continue;
+          int64_t idx = -1;
+          std::string_view id_sv, name_sv, args_sv;
+          for (auto tc_field : tc) {
+            std::string_view tc_key;
+            if (tc_field.unescaped_key().get(tc_key))
+              break;
+            if (tc_key == "index") {
+              if (tc_field.value().get_int64().get(idx))
+                idx = -1;
+            } else if (tc_key == "id") {
+              if (tc_field.value().get_string().get(id_sv))
+                id_sv = {};
+            } else if (tc_key == "function") {
+              simdjson::ondemand::object fn;
+              if (tc_field.value().get_object().get(fn))
+                continue;
+              for (auto fn_field : fn) {
+                std::string_view fn_key;
+                if (fn_field.unescaped_key().get(fn_key))
+                  break;
+                // function.arguments is streamed in chunks
+                if (fn_key == "name") {
+                  if (fn_field.value().get_string().get(name_sv))
+                    name_sv = {};
+                } else if (fn_key == "arguments") {
+                  if (fn_field.value().get_string().get(args_sv))
+                    args_sv = {};
+                }
+              }
+            }
+          }
+          if (idx < 0) {
             spdlog::warn("Missing index in tool_call chunk");
+            idx = 0;
           }
 
           // Grow accumulator array if needed
-          while ((int64_t)d->tool_calls.size() <= idx) {
-            d->tool_calls.push_back({});
+          while ((int64_t)data->tool_calls.size() <= idx) {
+            data->tool_calls.push_back({});
           }
-          auto &accum = d->tool_calls[idx];
-
-          // id
-          std::string_view id_sv;
-          if (!tc_elem["id"].get(id_sv))
+          auto &accum = data->tool_calls[idx];
+          if (!id_sv.empty())
             accum.id = std::string(id_sv);
-
-          // function.name
-          simdjson::dom::element fn_elem;
-          if (!tc_elem["function"].get(fn_elem)) {
-            std::string_view name_sv;
-            if (!fn_elem["name"].get(name_sv) && !name_sv.empty())
-              accum.name = std::string(name_sv);
-
-            // function.arguments (streamed in chunks)
-            std::string_view args_sv;
-            if (!fn_elem["arguments"].get(args_sv))
-              accum.arguments += std::string(args_sv);
-          }
+          if (!name_sv.empty())
+            accum.name = std::string(name_sv);
+          accum.arguments += args_sv;
         }
       }
+      break; // the first choice only
     }
+  });
+
+  // ── Write callback: frame the SSE stream ──────────────────────────────
+  auto write_cb = [](char *ptr, size_t size, size_t nmemb,
+                     void *userdata) -> size_t {
+    size_t total = size * nmemb;
+    auto *d = (CallData *)userdata;
+    if (!d->streamed && d->raw.size() < (64 << 10))
+      d->raw.append(ptr, total);
+    d->sse->feed(ptr, total);
     return total;
   };
 
@@ -536,27 +684,15 @@ LLMResponse Agent::call_llm(const std::vector<Message> &messages,
   fiber_suspend(0);
   spdlog::debug("Async LLM call resumed for fiber {}", (void *)data->fiber);
 
-  // Process leftover buffer
-  if (!data->buffer.empty()) {
-    std::string line = data->buffer;
-    if (line.rfind("data: ", 0) != 0) {
-      simdjson::dom::element j;
-      auto padded = simdjson::padded_string(line);
-      if (!data->parser.parse(padded).get(j)) {
-        simdjson::dom::element err;
-        if (!j["error"].get(err)) {
-          std::string_view msg;
-          if (!err["message"].get(msg))
-            data->text_content = "Error: " + std::string(msg);
-        }
-      }
-    }
-  }
+  // A body that never produced an event is an error response.
+  data->sse->finish();
+  if (!data->streamed && !data->raw.empty())
+    set_llm_error(data->raw, data->text_content);
 
   // Cleanup
   CurlMultiManager::instance().remove_handle(easy);
   curl_slist_free_all(data->headers);
-  curl_easy_cleanup(easy);
+  CurlMultiManager::instance().release(effective_endpoint, easy);
 
   // Assemble result
   LLMResponse result;
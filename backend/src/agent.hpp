@@ -11,6 +11,8 @@ using AgentEventCallback = EventCallback;
 class AgentLoop;
 class SessionManager;
 class SubagentManager;
+class EmbeddingCache;
+class StaticEmbedder;
 
 void init_spawn_system();
 void spawn_in_fiber(std::function<void()> task);
@@ -33,13 +35,27 @@ public:
     AgentLoop& loop();
     SessionManager& sessions();
 
+    // Re-embed memory indexed under a previous embedding model or dimension.
+    // Fiber-blocking; a no-op when there is nothing to do.
+    void reembed_memory();
+
+    // Wait for memory writes still queued in the background (shutdown).
+    void flush_memory();
+
 private:
     std::unique_ptr<AgentLoop> loop_;
     std::unique_ptr<SessionManager> sessions_;
     std::unique_ptr<SubagentManager> subagents_;
+    std::unique_ptr<EmbeddingCache> embed_cache_; // null when disabled
+    std::unique_ptr<StaticEmbedder> static_embedder_; // embedding.provider "static"
 
-    // Embedding call — fiber-blocking
+    // Embedding call — fiber-blocking unless the provider is "static", which
+    // embeds in-process. Otherwise answered from embed_cache_ when the
+    // text was embedded before, else coalesced with concurrent calls on the
+    // same node into one request (EmbedBatcher)
     std::vector<float> embed(const std::string& text);
+    std::vector<std::vector<float>> embed_batch(const std::vector<std::string>& texts,
+                                                const std::string& api_key);
 
     // LLM HTTP call — fiber-blocking, returns structured LLMResponse
     LLMResponse call_llm(
@@ -0,0 +1,106 @@
+#pragma once
+// Base64 decoding of packed little-endian float32 vectors, the "base64"
+// encoding_format of OpenAI-compatible /embeddings endpoints: a quarter of
+// the size of the decimal JSON array, and no float parsing.
+//
+// Bytes are decoded straight into the caller's float buffer, 16 characters
+// (three floats) per step with a table lookup per character and one validity
+// check per step, and the squared norm is accumulated as each step lands. The
+// decoder stops after the floats asked for, so MRL truncation skips the rest
+// of the string instead of decoding and discarding it.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace base64_detail {
+
+struct Table {
+    uint8_t v[256];
+    constexpr Table() : v() {
+        for (auto& x : v) x = 0xff;
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; ++i) v[(uint8_t)alphabet[i]] = (uint8_t)i;
+    }
+};
+inline constexpr Table kTable{};
+
+// Four characters to three bytes; bit 7 of `bad` is set by any invalid one,
+// '=' included: the final quad's padding is replaced before it gets here.
+inline void decode_quad(const uint8_t* src, uint8_t* dst, uint32_t& bad) {
+    const uint8_t* t = kTable.v;
+    uint32_t a = t[src[0]], b = t[src[1]], c = t[src[2]], d = t[src[3]];
+    bad |= a | b | c | d;
+    uint32_t v = a << 18 | b << 12 | c << 6 | d;
+    dst[0] = (uint8_t)(v >> 16);
+    dst[1] = (uint8_t)(v >> 8);
+    dst[2] = (uint8_t)v;
+}
+
+} // namespace base64_detail
+
+// Number of '=' padding characters ending `in`.
+inline size_t base64_padding(std::string_view in) {
+    if (in.size() < 4 || in.back() != '=') return 0;
+    return in[in.size() - 2] == '=' ? 2 : 1;
+}
+
+// Number of floats encoded in `in`; 0 if its length is not a multiple of 4.
+inline size_t base64_float_count(std::string_view in) {
+    if (in.empty() || in.size() % 4 != 0) return 0;
+    return (in.size() / 4 * 3 - base64_padding(in)) / sizeof(float);
+}
+
+// Decode the first min(max_floats, base64_float_count(in)) floats of `in`
+// into `out`, setting `sum_sq` to their squared L2 norm. Returns how many
+// were decoded, or 0 if `in` is malformed ('=' anywhere but the padding
+// at the very end included).
+inline size_t decode_base64_floats(std::string_view in, float* out, size_t max_floats, double& sum_sq) {
+    using base64_detail::decode_quad;
+    sum_sq = 0;
+    size_t n = std::min(base64_float_count(in), max_floats);
+    const auto* src = reinterpret_cast<const uint8_t*>(in.data());
+    auto* dst = reinterpret_cast<uint8_t*>(out);
+    uint32_t bad = 0;
+    float f[3];
+
+    // The padded final quad is decoded from a copy with its padding zeroed
+    // ('A'); the 16-character steps stop short of it.
+    size_t pad = base64_padding(in);
+    const uint8_t* last = pad ? src + in.size() - 4 : nullptr;
+    uint8_t unpadded[4] = {};
+    if (last) {
+        std::memcpy(unpadded, last, 4);
+        for (size_t k = 4 - pad; k < 4; ++k) unpadded[k] = 'A';
+    }
+    const uint8_t* stop = src + in.size() - (pad ? 4 : 0);
+
+    size_t i = 0;
+    for (; i + 3 <= n && src + 16 <= stop; i += 3, src += 16, dst += 12) {
+        decode_quad(src, dst, bad);
+        decode_quad(src + 4, dst + 3, bad);
+        decode_quad(src + 8, dst + 6, bad);
+        decode_quad(src + 12, dst + 9, bad);
+        std::memcpy(f, dst, sizeof(f));
+        sum_sq += (double)f[0] * f[0] + (double)f[1] * f[1] + (double)f[2] * f[2];
+    }
+    // The last one to three floats go through scratch space, since their
+    // final quad decodes bytes past the end of `out`.
+    if (i < n) {
+        uint8_t tail[12];
+        size_t bytes = (n - i) * sizeof(float);
+        for (size_t q = 0; q * 3 < bytes; ++q) {
+            const uint8_t* quad = src + q * 4;
+            decode_quad(quad == last ? unpadded : quad, tail + q * 3, bad);
+        }
+        std::memcpy(dst, tail, bytes);
+        std::memcpy(f, tail, bytes);
+        for (size_t k = 0; k < n - i; ++k) sum_sq += (double)f[k] * f[k];
+    }
+    if (bad & 0x80) {
+        sum_sq = 0;
+        return 0;
+    }
+    return n;
+}
@@ -4,6 +4,9 @@
 #include <spdlog/spdlog.h>
 #include <string>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 struct CurlContext {
     uv_poll_t poll_handle;
@@ -11,6 +14,38 @@ struct CurlContext {
     class CurlMultiManager* manager;
 };
 
+// Process-wide CURLSH: every node's requests share one DNS cache and one TLS
+// session cache, so a host resolved or a handshake completed on one node is
+// resumed on the others. Connections themselves stay in each node's multi
+// handle; libcurl does not support sharing them between concurrent threads.
+class CurlShare {
+public:
+    static CURLSH* get() {
+        static CurlShare inst;
+        return inst.share_;
+    }
+
+private:
+    CurlShare() {
+        share_ = curl_share_init();
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+
+    static void lock(CURL*, curl_lock_data data, curl_lock_access, void* userp) {
+        ((CurlShare*)userp)->locks_[data].lock();
+    }
+    static void unlock(CURL*, curl_lock_data data, void* userp) {
+        ((CurlShare*)userp)->locks_[data].unlock();
+    }
+
+    CURLSH* share_ = nullptr;
+    std::mutex locks_[CURL_LOCK_DATA_LAST];
+};
+
 class CurlMultiManager {
 public:
     static CurlMultiManager& instance() {
@@ -25,6 +60,7 @@ public:
         curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
         curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, timer_callback);
         curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
         
         uv_timer_init(loop, &timer_handle_);
         timer_handle_.data = this;
@@ -32,6 +68,39 @@ public:
 
     CURLM* multi() { return multi_; }
 
+    // An easy handle for a request to `url`, reused from the last request to
+    // the same origin when one is idle. Requests to one origin go out on this
+    // node's open connection to it: multiplexed over HTTP/2 when the server
+    // negotiates it, else kept alive for the next HTTP/1.1 request.
+    CURL* acquire(const std::string& url) {
+        CURL* easy = nullptr;
+        auto it = idle_.find(origin(url));
+        if (it != idle_.end() && !it->second.empty()) {
+            easy = it->second.back();
+            it->second.pop_back();
+        } else {
+            easy = curl_easy_init();
+        }
+        curl_easy_setopt(easy, CURLOPT_SHARE, CurlShare::get());
+        curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L); // wait to multiplex rather than open another connection
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+        return easy;
+    }
+
+    // Return a handle from acquire(), after remove_handle(). Its options are
+    // reset; its caches stay with it.
+    void release(const std::string& url, CURL* easy) {
+        auto& idle = idle_[origin(url)];
+        if (idle.size() >= kMaxIdlePerOrigin) {
+            curl_easy_cleanup(easy);
+            return;
+        }
+        curl_easy_reset(easy);
+        idle.push_back(easy);
+    }
+
     void add_handle(CURL* easy) {
         curl_multi_add_handle(multi_, easy);
     }
@@ -59,6 +128,16 @@ public:
 private:
     CurlMultiManager() = default;
 
+    static constexpr size_t kMaxIdlePerOrigin = 8;
+
+    // scheme://host[:port] of `url`.
+    static std::string origin(const std::string& url) {
+        size_t host = url.find("://");
+        host = host == std::string::npos ? 0 : host + 3;
+        size_t end = url.find_first_of("/?#", host);
+        return url.substr(0, end);
+    }
+
     static int socket_callback(CURL* easy, curl_socket_t s, int action, void* userp, void* socketp) {
         auto* self = (CurlMultiManager*)userp;
         auto* ctx = (CurlContext*)socketp;
@@ -118,4 +197,5 @@ private:
     CURLM* multi_ = nullptr;
     uv_loop_t* loop_ = nullptr;
     uv_timer_t timer_handle_;
+    std::unordered_map<std::string, std::vector<CURL*>> idle_; // origin -> idle easy handles
 };
@@ -0,0 +1,111 @@
+#pragma once
+// EmbedBatcher — coalesces embedding requests from the fibers of one node.
+//
+// The first fiber to ask opens a batch and waits up to `window_ms`; every
+// fiber that asks meanwhile (for the same group, e.g. API key) joins it and
+// suspends. When the window closes, or the batch reaches `max_batch` texts,
+// the first fiber sends the whole batch in one request and resumes each of
+// the others with its own vector. All of a node's fibers share its thread,
+// so the batcher is thread_local and needs no locking, like CurlMultiManager.
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fiber.h>
+#include <uv.h>
+#include <spdlog/spdlog.h>
+
+#include "fiber_pool.hpp"
+
+class EmbedBatcher {
+public:
+    // Embeds a batch of texts: one vector per text, empty where it failed.
+    using SendFn = std::function<std::vector<std::vector<float>>(const std::vector<std::string>&)>;
+
+    static EmbedBatcher& instance() {
+        static thread_local EmbedBatcher inst;
+        return inst;
+    }
+
+    std::vector<float> embed(const std::string& group, const std::string& text, const SendFn& send,
+                             size_t max_batch, int window_ms) {
+        FiberNode* node = FiberNode::current();
+        fiber_t self = fiber_ident();
+        if (!node || !self || max_batch <= 1 || window_ms <= 0) return send_one(send, text);
+
+        auto open = open_.find(group);
+        if (open != open_.end()) {
+            auto batch = open->second;
+            size_t slot = batch->texts.size();
+            batch->texts.push_back(text);
+            batch->waiters.push_back(self);
+            if (batch->texts.size() >= max_batch) {
+                open_.erase(open);
+                if (!batch->released) {
+                    batch->released = true;
+                    uv_timer_stop(batch->timer);
+                    fiber_t leader = batch->leader;
+                    node->spawn_back_on_loop([leader]() { fiber_resume(leader); });
+                }
+            }
+            fiber_suspend(0);
+            return std::move(batch->results[slot]);
+        }
+
+        auto batch = std::make_shared<Batch>();
+        batch->leader = self;
+        batch->texts.push_back(text);
+        batch->timer = new uv_timer_t;
+        uv_timer_init(node->loop(), batch->timer);
+        batch->timer->data = batch.get();
+        uv_timer_start(batch->timer, [](uv_timer_t* handle) {
+            auto* b = (Batch*)handle->data;
+            if (b->released) return;
+            b->released = true;
+            fiber_resume(b->leader);
+        }, (uint64_t)window_ms, 0);
+        open_[group] = batch;
+        fiber_suspend(0); // until the window closes or the batch fills
+
+        auto still = open_.find(group);
+        if (still != open_.end() && still->second == batch) open_.erase(still);
+        uv_timer_stop(batch->timer);
+        uv_close((uv_handle_t*)batch->timer, [](uv_handle_t* h) { delete (uv_timer_t*)h; });
+
+        std::vector<std::vector<float>> results;
+        try {
+            results = send(batch->texts);
+        } catch (const std::exception& e) {
+            spdlog::warn("Embedding batch of {} failed: {}", batch->texts.size(), e.what());
+        }
+        results.resize(batch->texts.size());
+        if (batch->texts.size() > 1) spdlog::debug("Embedded a batch of {} texts", batch->texts.size());
+
+        batch->results = std::move(results);
+        for (fiber_t waiter : batch->waiters) {
+            node->spawn_back_on_loop([waiter]() { fiber_resume(waiter); });
+        }
+        return std::move(batch->results[0]);
+    }
+
+private:
+    struct Batch {
+        fiber_t leader;
+        std::vector<std::string> texts; // texts[0] is the leader's
+        std::vector<fiber_t> waiters;   // waiters[i] asked for texts[i + 1]
+        std::vector<std::vector<float>> results;
+        uv_timer_t* timer = nullptr;
+        bool released = false;          // the leader has been woken to send
+    };
+
+    EmbedBatcher() = default;
+
+    static std::vector<float> send_one(const SendFn& send, const std::string& text) {
+        auto results = send({text});
+        return results.empty() ? std::vector<float>{} : std::move(results[0]);
+    }
+
+    std::map<std::string, std::shared_ptr<Batch>> open_; // open batch per group
+};
@@ -0,0 +1,196 @@
+#pragma once
+// EmbeddingCache — embeddings already computed, by content.
+//
+// Entries are keyed by a 128-bit hash of the text and kept in two tiers: a
+// small in-memory LRU of hot vectors, in front of an append-only file of
+// every vector computed so far, memory-mapped and indexed by key at open.
+//
+//   header   64 bytes: magic, version, dimension, hash of the model name
+//   records  16-byte key followed by `dimension` floats
+//
+// A file made for another model or dimension is started afresh, as is one
+// that outgrows `max_bytes`. Thread-safe; every node shares one instance.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.hpp"
+#include "rank_fusion.hpp"
+
+namespace fs = std::filesystem;
+
+class EmbeddingCache {
+public:
+    EmbeddingCache(const fs::path& path, const std::string& model, int dim, size_t memory_entries, uint64_t max_bytes)
+        : path_(path), model_hash_(doc_key(model)), dim_(dim),
+          memory_entries_(memory_entries), max_bytes_(max_bytes) {
+        std::error_code ec;
+        fs::create_directories(path_.parent_path(), ec);
+        load();
+    }
+
+    bool get(std::string_view text, std::vector<float>& out) {
+        Key key = key_of(text);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (auto it = lru_index_.find(key); it != lru_index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            out = it->second->second;
+            ++hits_;
+            return true;
+        }
+        auto it = offsets_.find(key);
+        if (it == offsets_.end() || it->second + record_bytes() > map_.size()) {
+            ++misses_;
+            return false;
+        }
+        const float* v = reinterpret_cast<const float*>(map_.data() + it->second + sizeof(Key));
+        out.assign(v, v + dim_);
+        remember(key, out);
+        ++hits_;
+        return true;
+    }
+
+    // Vectors of another dimension (failed or untruncated embeddings) are not kept.
+    void put(std::string_view text, const std::vector<float>& embedding) {
+        if ((int)embedding.size() != dim_) return;
+        Key key = key_of(text);
+        std::lock_guard<std::mutex> lock(mutex_);
+        remember(key, embedding);
+        if (offsets_.count(key) || !out_.is_open()) return;
+        if (file_bytes_ + record_bytes() > max_bytes_) {
+            spdlog::info("Embedding cache {} reached {} MB; starting it afresh", path_.string(), max_bytes_ >> 20);
+            reset();
+        }
+        out_.write(reinterpret_cast<const char*>(&key), sizeof(key));
+        out_.write(reinterpret_cast<const char*>(embedding.data()), (std::streamsize)(dim_ * sizeof(float)));
+        out_.flush();
+        offsets_[key] = file_bytes_;
+        file_bytes_ += record_bytes();
+        if (map_.size() < file_bytes_) map_.grow();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return offsets_.size();
+    }
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+private:
+    struct Key {
+        uint64_t lo;
+        uint64_t hi;
+        bool operator==(const Key& o) const { return lo == o.lo && hi == o.hi; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const { return (size_t)(k.lo ^ (k.hi * 0x9e3779b97f4a7c15ull)); }
+    };
+
+    static constexpr uint64_t kHeaderBytes = 64;
+    static constexpr uint32_t kMagic = 0x43424d45; // "EMBC"
+    static constexpr uint32_t kVersion = 1;
+
+    uint64_t record_bytes() const { return sizeof(Key) + (uint64_t)dim_ * sizeof(float); }
+
+    // FNV-1a, plus a second pass from another basis that also folds in the
+    // length, so two texts share an entry only if both 64-bit halves collide.
+    static Key key_of(std::string_view text) {
+        uint64_t hi = 0x84222325cbf29ce4ull ^ text.size();
+        for (unsigned char c : text) {
+            hi ^= c;
+            hi *= 0x100000001b3ull;
+        }
+        return {doc_key(text), hi};
+    }
+
+    void remember(const Key& key, const std::vector<float>& v) {
+        if (memory_entries_ == 0) return;
+        if (auto it = lru_index_.find(key); it != lru_index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return;
+        }
+        lru_.emplace_front(key, v);
+        lru_index_[key] = lru_.begin();
+        if (lru_.size() > memory_entries_) {
+            lru_index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+
+    void load() {
+        std::error_code ec;
+        uint64_t bytes = fs::exists(path_, ec) ? fs::file_size(path_, ec) : 0;
+        uint32_t head[4] = {0, 0, 0, 0};
+        uint64_t model = 0;
+        if (bytes >= kHeaderBytes) {
+            std::ifstream in(path_, std::ios::binary);
+            in.read(reinterpret_cast<char*>(head), sizeof(head));
+            in.read(reinterpret_cast<char*>(&model), sizeof(model));
+        }
+        if (head[0] != kMagic || head[1] != kVersion || head[2] != (uint32_t)dim_ || model != model_hash_) {
+            if (bytes > 0) spdlog::info("Embedding cache {} is for another model or dimension; starting it afresh", path_.string());
+            reset();
+            return;
+        }
+
+        uint64_t records = (bytes - kHeaderBytes) / record_bytes();
+        file_bytes_ = kHeaderBytes + records * record_bytes();
+        if (file_bytes_ != bytes) fs::resize_file(path_, file_bytes_, ec); // torn tail
+        map_.open(path_);
+        for (uint64_t r = 0; r < records; ++r) {
+            uint64_t off = kHeaderBytes + r * record_bytes();
+            Key key;
+            std::memcpy(&key, map_.data() + off, sizeof(key));
+            offsets_.emplace(key, off);
+        }
+        out_.open(path_, std::ios::binary | std::ios::app);
+        if (!out_.is_open()) spdlog::warn("Failed to open embedding cache {}", path_.string());
+        if (records > 0) spdlog::info("Embedding cache: {} vectors in {}", records, path_.string());
+    }
+
+    void reset() {
+        out_.close();
+        map_.close();
+        offsets_.clear();
+        char header[kHeaderBytes] = {};
+        uint32_t fields[4] = {kMagic, kVersion, (uint32_t)dim_, 0};
+        std::memcpy(header, fields, sizeof(fields));
+        std::memcpy(header + sizeof(fields), &model_hash_, sizeof(model_hash_));
+        {
+            std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+            out.write(header, sizeof(header));
+        }
+        file_bytes_ = kHeaderBytes;
+        map_.open(path_);
+        out_.open(path_, std::ios::binary | std::ios::app);
+        if (!out_.is_open()) spdlog::warn("Failed to open embedding cache {}", path_.string());
+    }
+
+    fs::path path_;
+    uint64_t model_hash_;
+    int dim_;
+    size_t memory_entries_;
+    uint64_t max_bytes_;
+
+    mutable std::mutex mutex_;
+    std::list<std::pair<Key, std::vector<float>>> lru_; // most recently used first
+    std::unordered_map<Key, std::list<std::pair<Key, std::vector<float>>>::iterator, KeyHash> lru_index_;
+    std::unordered_map<Key, uint64_t, KeyHash> offsets_; // key -> record offset in the file
+    uint64_t file_bytes_ = 0;
+    std::ofstream out_;
+    MappedFile map_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
@@ -0,0 +1,131 @@
+#pragma once
+// IndexQueue — write-behind indexing for MemoryStore.
+//
+// push() queues a document and returns at once. A fiber on the pushing node
+// drains the queue: it embeds up to `batch_size` documents at a time with
+// embed_concurrently and adds each batch to the index in one worker request.
+// The queue is bounded; when it is full, or there is no fiber to drain it,
+// push() refuses and the caller indexes inline, so a slow embedder slows the
+// producer down instead of growing the queue without limit.
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fiber.h>
+#include <spdlog/spdlog.h>
+
+#include "agent_types.hpp"
+#include "fiber_pool.hpp"
+#include "ingest.hpp"
+#include "memory_index.hpp"
+
+class IndexQueue : public std::enable_shared_from_this<IndexQueue> {
+public:
+    IndexQueue(std::shared_ptr<MemoryIndex> index, EmbeddingFn embed, size_t capacity, size_t batch_size,
+               size_t max_in_flight)
+        : index_(std::move(index))
+        , embed_(std::move(embed))
+        , capacity_(capacity)
+        , batch_size_(std::max<size_t>(batch_size, 1))
+        , max_in_flight_(std::max<size_t>(max_in_flight, 1)) {}
+
+    void set_embedding_fn(EmbeddingFn embed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        embed_ = std::move(embed);
+    }
+
+    // Queue `doc` to be embedded and indexed. False, with `doc` untouched,
+    // if the caller must index it itself.
+    bool push(MemoryIndex::Doc&& doc) {
+        FiberNode* node = FiberNode::current();
+        if (!node || !fiber_ident()) return false;
+        bool start = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_.size() >= capacity_) return false;
+            pending_.push_back(std::move(doc));
+            start = !draining_;
+            draining_ = true;
+        }
+        if (start) {
+            node->spawn([self = shared_from_this()]() { self->drain(); });
+        }
+        return true;
+    }
+
+    // Block the calling fiber (or thread) until everything queued so far is
+    // in the index.
+    void flush() {
+        FiberNode* node = FiberNode::current();
+        fiber_t self = fiber_ident();
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!draining_) return;
+        if (node && self) {
+            waiters_.push_back([node, self]() {
+                node->spawn([self]() { fiber_resume(self); });
+            });
+            lock.unlock();
+            fiber_suspend(0);
+        } else {
+            idle_cv_.wait(lock, [this] { return !draining_; });
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_.size();
+    }
+
+private:
+    void drain() {
+        while (true) {
+            std::vector<MemoryIndex::Doc> batch;
+            EmbeddingFn embed;
+            std::vector<std::function<void()>> waiters;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_.empty()) {
+                    draining_ = false;
+                    waiters.swap(waiters_);
+                    idle_cv_.notify_all();
+                } else {
+                    embed = embed_;
+                    size_t n = std::min(batch_size_, pending_.size());
+                    for (size_t i = 0; i < n; ++i) {
+                        batch.push_back(std::move(pending_.front()));
+                        pending_.pop_front();
+                    }
+                }
+            }
+            if (batch.empty()) {
+                for (auto& wake : waiters) wake();
+                return;
+            }
+            try {
+                std::vector<std::string> texts;
+                texts.reserve(batch.size());
+                for (const auto& doc : batch) texts.push_back(doc.text);
+                auto embeddings = embed_concurrently(embed, texts, max_in_flight_);
+                for (size_t i = 0; i < batch.size(); ++i) batch[i].embedding = std::move(embeddings[i]);
+                index_->add_documents(batch);
+            } catch (const std::exception& e) {
+                spdlog::warn("Write-behind indexing of {} documents failed: {}", batch.size(), e.what());
+            }
+        }
+    }
+
+    std::shared_ptr<MemoryIndex> index_;
+    EmbeddingFn embed_; // guarded by mutex_
+    size_t capacity_;
+    size_t batch_size_;
+    size_t max_in_flight_;
+    mutable std::mutex mutex_;
+    std::deque<MemoryIndex::Doc> pending_;
+    bool draining_ = false; // a drain fiber is running; it clears this when the queue is empty
+    std::vector<std::function<void()>> waiters_;
+    std::condition_variable idle_cv_;
+};
@@ -0,0 +1,129 @@
+#pragma once
+// Document ingestion helpers for MemoryStore::index_document.
+//
+//   chunk_lines         split a file into overlapping, line-ranged chunks
+//   embed_concurrently  embed many texts with a bounded number of requests
+//                       in flight, one fiber per request slot
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fiber.h>
+#include <spdlog/spdlog.h>
+
+#include "agent_types.hpp"
+#include "fiber_pool.hpp"
+
+struct Chunk {
+    int start_line; // 1-based, inclusive
+    int end_line;
+    std::string text;
+};
+
+// Pack whole lines into chunks of at most `max_chars`, each starting with
+// about `overlap_chars` worth of the previous chunk's trailing lines so a
+// passage cut at a boundary is still found whole in one of them. A line
+// longer than `max_chars` is split, and its pieces keep its line number.
+inline std::vector<Chunk> chunk_lines(std::string_view text, size_t max_chars, size_t overlap_chars) {
+    struct Piece { int line; std::string_view text; };
+    std::vector<Piece> pieces;
+    max_chars = std::max<size_t>(max_chars, 1);
+
+    int line_no = 0;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string_view::npos) eol = text.size();
+        std::string_view line = text.substr(pos, eol - pos);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        ++line_no;
+        do {
+            pieces.push_back({line_no, line.substr(0, max_chars)});
+            line.remove_prefix(std::min(line.size(), max_chars));
+        } while (!line.empty());
+        pos = eol + 1;
+    }
+
+    std::vector<Chunk> chunks;
+    size_t start = 0;
+    while (start < pieces.size()) {
+        // Take pieces until the budget is spent (at least one); each joined
+        // piece costs its length plus a newline.
+        size_t end = start;
+        size_t chars = 0;
+        while (end < pieces.size() && (end == start || chars + pieces[end].text.size() < max_chars)) {
+            chars += pieces[end].text.size() + 1;
+            ++end;
+        }
+
+        Chunk chunk{pieces[start].line, pieces[end - 1].line, {}};
+        chunk.text.reserve(chars);
+        for (size_t i = start; i < end; ++i) {
+            if (i > start) chunk.text += '\n';
+            chunk.text.append(pieces[i].text);
+        }
+        if (chunk.text.find_first_not_of(" \t\n") != std::string::npos) {
+            chunks.push_back(std::move(chunk));
+        }
+        if (end == pieces.size()) break;
+
+        // Step back over trailing pieces for the overlap, always advancing.
+        size_t next = end;
+        size_t overlap = 0;
+        while (next - 1 > start && overlap + pieces[next - 1].text.size() + 1 <= overlap_chars) {
+            overlap += pieces[next - 1].text.size() + 1;
+            --next;
+        }
+        start = next;
+    }
+    return chunks;
+}
+
+// Embed `texts` in order. On a fiber node up to `max_in_flight` requests run
+// at once, each on its own fiber, and the calling fiber sleeps until the last
+// one finishes; elsewhere (tests, worker threads) they run one by one. A text
+// whose embedding fails gets an empty vector.
+inline std::vector<std::vector<float>> embed_concurrently(
+    const EmbeddingFn& embed, const std::vector<std::string>& texts, size_t max_in_flight) {
+    std::vector<std::vector<float>> out(texts.size());
+    if (!embed || texts.empty()) return out;
+
+    auto embed_one = [&](size_t i) {
+        try {
+            out[i] = embed(texts[i]);
+        } catch (const std::exception& e) {
+            spdlog::warn("Embedding chunk {} failed: {}", i, e.what());
+        }
+    };
+
+    FiberNode* node = FiberNode::current();
+    fiber_t self = fiber_ident();
+    if (!node || !self || max_in_flight <= 1 || texts.size() == 1) {
+        for (size_t i = 0; i < texts.size(); ++i) embed_one(i);
+        return out;
+    }
+
+    // All fibers share this node's thread, so plain counters suffice. The
+    // state lives on this stack, which outlives every worker.
+    size_t next = 0;
+    size_t running = std::min(max_in_flight, texts.size());
+    bool waiting = false;
+    uint64_t api_key = fiber_get_localdata(self, 1); // per-request key override
+    auto worker = [&]() {
+        fiber_set_localdata(fiber_ident(), 1, api_key);
+        while (next < texts.size()) embed_one(next++);
+        fiber_set_localdata(fiber_ident(), 1, 0);
+        if (--running == 0 && waiting) {
+            node->spawn_back_on_loop([self]() { fiber_resume(self); });
+        }
+    };
+
+    for (size_t i = 0, n = running; i < n; ++i) node->spawn(worker);
+    if (running > 0) {
+        waiting = true;
+        fiber_suspend(0);
+    }
+    return out;
+}
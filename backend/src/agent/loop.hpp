@@ -9,6 +9,7 @@
 #include <fiber.hpp>
 #include "../config.hpp"
 #include <simdjson.h>
+#include <fstream>
 #include <sstream>
 #include <spdlog/spdlog.h>
 
@@ -26,7 +27,7 @@ public:
         EmbeddingFn embed_fn,
         int max_iterations = 10
     )
-        : context_(workspace)
+        : context_(workspace, embed_fn)
         , llm_fn_(std::move(llm_fn))
         , embed_fn_(std::move(embed_fn))
         , max_iterations_(max_iterations)
@@ -89,6 +90,59 @@ public:
         return result;
     }
 
+    // index_document: chunk, embed and index `text`, or the file at `path`
+    // when no text is given. Re-indexing a path replaces its old chunks.
+    std::string index_document(const std::string& path, std::string text) {
+        if (path.empty()) return "Error: missing 'path' argument";
+        if (text.empty()) {
+            std::ifstream f(path, std::ios::binary);
+            if (!f.is_open()) return "Error: Cannot open file: " + path;
+            std::stringstream buffer;
+            buffer << f.rdbuf();
+            text = buffer.str();
+        }
+        size_t n = context_.memory().index_document(path, text, embed_fn_);
+        return "Indexed " + std::to_string(n) + " chunks from " + path;
+    }
+
+    // memory_search filter arguments. "session" may be "current"; dates are
+    // YYYY-MM-DD and "until" covers the whole day.
+    static SearchFilter parse_search_filter(const std::map<std::string, std::string>& args, const std::string& session_key) {
+        SearchFilter filter;
+        auto arg = [&](const char* key) {
+            auto it = args.find(key);
+            return it != args.end() ? it->second : std::string();
+        };
+
+        std::string sources = arg("sources");
+        if (!sources.empty() && sources[0] == '[') {
+            try {
+                simdjson::dom::parser parser;
+                simdjson::dom::array arr;
+                if (!parser.parse(simdjson::padded_string(sources)).get(arr)) {
+                    for (auto v : arr) {
+                        std::string_view sv;
+                        if (!v.get(sv)) filter.sources.emplace_back(sv);
+                    }
+                }
+            } catch (...) {
+                spdlog::warn("parse_search_filter: bad sources: {}", sources);
+            }
+        } else if (!sources.empty()) {
+            std::stringstream ss(sources);
+            for (std::string s; std::getline(ss, s, ',');) {
+                if (!s.empty()) filter.sources.push_back(s);
+            }
+        }
+
+        filter.session = arg("session");
+        if (filter.session == "current") filter.session = session_key;
+        filter.path_prefix = arg("path_prefix");
+        filter.since = date_from_path(arg("since"));
+        if (int64_t until = date_from_path(arg("until"))) filter.until = until + 86399;
+        return filter;
+    }
+
     // Build the "assistant" message with tool_calls for the API
     static Message make_assistant_tool_call_message(const std::string& content, const std::vector<ToolCall>& calls) {
         Message msg;
@@ -171,22 +225,30 @@ public:
                     on_event({"tool_start", tc.name + ": " + tc.arguments_json});
 
                     std::string output;
-                    if (tools_.count(tc.name)) {
-                        auto args = parse_arguments(tc.arguments_json);
-                        output = tools_.at(tc.name)->execute(args);
-                    } else if (tc.name == "memory_search") {
+                    // memory_search and index_document are registered only for
+                    // their schemas, so they must be matched before the generic
+                    // dispatch.
+                    if (tc.name == "memory_search") {
                         auto args = parse_arguments(tc.arguments_json);
                         std::string query = args["query"];
-                        std::vector<float> emb;
-                        if (embed_fn_) emb = embed_fn_(query);
-                        auto results = context_.memory().search(query, emb);
+                        SearchFilter filter = parse_search_filter(args, session.key);
+                        // Embedded only if the index has not cached this search.
+                        auto results = context_.memory().search(query, {}, filter, embed_fn_);
                         
                         std::stringstream ss;
                         ss << "Search Results for \"" << query << "\":\n";
                         for (const auto& r : results) {
-                            ss << "- [" << r.source << "] " << r.path << ": " << r.text.substr(0, 200) << " (Score: " << r.score << ")\n";
+                            ss << "- [" << r.source << "] " << r.path;
+                            if (r.end_line > 0) ss << ":" << r.start_line << "-" << r.end_line;
+                            ss << ": " << r.text.substr(0, 200) << " (Score: " << r.score << ")\n";
                         }
                         output = ss.str();
+                    } else if (tc.name == "index_document") {
+                        auto args = parse_arguments(tc.arguments_json);
+                        output = index_document(args["path"], args["text"]);
+                    } else if (tools_.count(tc.name)) {
+                        auto args = parse_arguments(tc.arguments_json);
+                        output = tools_.at(tc.name)->execute(args);
                     } else {
                         output = "Error: unknown tool '" + tc.name + "'";
                     }
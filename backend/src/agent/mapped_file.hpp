@@ -0,0 +1,148 @@
+#pragma once
+// MappedFile — read-only memory mapping of a file that may grow by appends.
+// remap() picks up the new length; callers that read past size() remap first.
+// grow() does the same for files appended to often: on POSIX the mapping is
+// reserved with headroom past the end, so most calls only re-read the length.
+// sync_file() forces a file's written bytes to the storage device.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// fsync a file by path. Its writers are std::ofstreams, which expose no
+// handle, and a separate one syncs the same data; callable from any thread.
+inline bool sync_file(const fs::path& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const fs::path& path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const fs::path& path) {
+        close();
+        path_ = path;
+        return remap();
+    }
+
+    // Map the file at its current length. Returns false if it is missing or empty.
+    bool remap() { return map(0); }
+
+    bool grow() {
+#ifndef _WIN32
+        struct stat st;
+        if (path_.empty() || ::stat(path_.c_str(), &st) != 0) return false;
+        size_t len = (size_t)st.st_size;
+        if (data_ && len <= capacity_) {
+            size_ = len;
+            return true;
+        }
+        return map(len + len / 2);
+#else
+        return remap();
+#endif
+    }
+
+    void close() {
+        unmap();
+        path_.clear();
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool is_open() const { return data_ != nullptr; }
+
+private:
+    // Pages past the end of the file are never read; they become valid as
+    // appends reach them.
+    bool map(size_t reserve) {
+        unmap();
+        if (path_.empty()) return false;
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path_.wstring().c_str(), GENERIC_READ,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                  nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER len;
+        if (!GetFileSizeEx(file, &len) || len.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) return false;
+        void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!p) return false;
+        data_ = static_cast<const uint8_t*>(p);
+        size_ = (size_t)len.QuadPart;
+        capacity_ = size_;
+        (void)reserve;
+#else
+        int fd = ::open(path_.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size_t length = std::max((size_t)st.st_size, reserve);
+        void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        data_ = static_cast<const uint8_t*>(p);
+        size_ = (size_t)st.st_size;
+        capacity_ = length;
+#endif
+        return true;
+    }
+
+    void unmap() {
+        if (!data_) return;
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+#else
+        munmap(const_cast<uint8_t*>(data_), capacity_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        capacity_ = 0;
+    }
+
+    fs::path path_;
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0; // mapped length; >= size_
+};
@@ -0,0 +1,53 @@
+#pragma once
+// MappedFlatIndex — exact inner-product Faiss index whose rows live in a
+// VectorFile rather than in Faiss-owned memory. It stands in for IndexFlatIP
+// under fp32 storage: opening it maps vectors.f32 instead of reading a
+// serialized index, so startup does no per-row work and the pages are shared
+// between processes. Searches run the same kernel IndexFlatIP uses.
+
+#include <algorithm>
+#include <cstring>
+#include <faiss/Index.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/distances.h>
+
+#include "vector_file.hpp"
+
+class MappedFlatIndex : public faiss::Index {
+public:
+    // `rows` must outlive the index; adds are appended to it.
+    explicit MappedFlatIndex(VectorFile* rows)
+        : faiss::Index(rows->dim(), faiss::METRIC_INNER_PRODUCT), rows_(rows) {
+        ntotal = (faiss::idx_t)rows_->size();
+        is_trained = true;
+    }
+
+    void add(faiss::idx_t n, const float* x) override {
+        rows_->append(x, (size_t)n);
+        rows_->flush();
+        ntotal += n;
+    }
+
+    void search(faiss::idx_t n, const float* x, faiss::idx_t k, float* distances, faiss::idx_t* labels,
+                const faiss::SearchParameters* params = nullptr) const override {
+        const faiss::IDSelector* sel = params ? params->sel : nullptr;
+        size_t ny = std::min<size_t>((size_t)ntotal, rows_->readable());
+        const float* xb = ny > 0 ? rows_->row(0) : nullptr;
+        faiss::float_minheap_array_t res = {size_t(n), size_t(k), labels, distances};
+        faiss::knn_inner_product(x, xb, d, (size_t)n, xb ? ny : 0, &res, sel);
+    }
+
+    void reconstruct(faiss::idx_t key, float* recons) const override {
+        const float* v = rows_->row((size_t)key);
+        if (v) std::memcpy(recons, v, sizeof(float) * d);
+        else std::fill(recons, recons + d, 0.0f);
+    }
+
+    void reset() override {
+        rows_->reset();
+        ntotal = 0;
+    }
+
+private:
+    VectorFile* rows_;
+};
@@ -16,6 +16,8 @@
 namespace fs = std::filesystem;
 
 #include "memory_index.hpp"
+#include "ingest.hpp"
+#include "index_queue.hpp"
 #include "config.hpp"
 
 class MemoryStore {
@@ -24,14 +26,25 @@ public:
         : workspace_(workspace)
         , memory_dir_(fs::path(workspace) / "memory")
         , memory_file_(memory_dir_ / "MEMORY.md")
-        , index_(std::make_unique<MemoryIndex>(fs::path(workspace) / "index", Config::instance().embedding_dimension()))
+        , index_(MemoryIndex::open_shared(fs::path(workspace) / "index", Config::instance().embedding_dimension(), index_options()))
         , embed_fn_(std::move(embed_fn))
+        , session_queue_(std::make_shared<IndexQueue>(index_, embed_fn_,
+              (size_t)std::max(Config::instance().memory_index_queue_capacity(), 0),
+              (size_t)Config::instance().memory_index_batch_size(),
+              (size_t)Config::instance().embedding_max_in_flight()))
     {
         fs::create_directories(memory_dir_);
     }
 
+    // Each store has its own session queue, and a subagent's goes away with
+    // its loop: what it still holds is indexed first.
+    ~MemoryStore() {
+        flush_session_index();
+    }
+
     void set_embedding_fn(EmbeddingFn embed_fn) {
         embed_fn_ = std::move(embed_fn);
+        session_queue_->set_embedding_fn(embed_fn_);
     }
 
     // ── Long-term memory (MEMORY.md - Layer 3) ───────────────────────────────
@@ -45,7 +58,7 @@ public:
         // Index L3
         std::vector<float> emb;
         if (embed_fn_) emb = embed_fn_(content);
-        index_->add_document("L3_MEMORY", memory_file_.string(), 0, 0, content, emb, "long-term");
+        index_->upsert_document("L3_MEMORY", memory_file_.string(), 0, 0, content, emb, "long-term");
     }
 
     // ── Daily Logs (memory/YYYY-MM-DD.md - Layer 2) ─────────────────────────
@@ -70,23 +83,82 @@ public:
         index_->add_document(id, daily_file.string(), 0, 0, content, emb, "memory");
     }
 
-    // ── Search ───────────────────────────────────────────────────────────────
+    // ── Documents ────────────────────────────────────────────────────────────
+
+    // Index `text` as overlapping line-ranged chunks, replacing whatever was
+    // indexed under `path` before. `embed` overrides the store's embedder.
+    // Returns the number of chunks stored.
+    size_t index_document(const std::string& path, const std::string& text,
+                          const EmbeddingFn& embed = nullptr, const std::string& source = "memory") {
+        const auto& cfg = Config::instance();
+        auto chunks = chunk_lines(text, (size_t)std::max(cfg.memory_chunk_chars(), 1),
+                                  (size_t)std::max(cfg.memory_chunk_overlap_chars(), 0));
+
+        std::vector<std::string> texts;
+        texts.reserve(chunks.size());
+        for (const auto& c : chunks) texts.push_back(c.text);
+        auto embeddings = embed_concurrently(embed ? embed : embed_fn_, texts, (size_t)std::max(cfg.embedding_max_in_flight(), 1));
 
-    std::vector<SearchResult> search(const std::string& query, const std::vector<float>& embedding = {}) {
-        std::vector<float> emb = embedding;
-        if (emb.empty() && !query.empty() && embed_fn_) {
-            emb = embed_fn_(query);
+        std::vector<MemoryIndex::Doc> docs;
+        docs.reserve(chunks.size());
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            auto& c = chunks[i];
+            std::string id = "DOC_" + path + "#" + std::to_string(i);
+            docs.push_back({std::move(id), path, c.start_line, c.end_line, std::move(c.text), std::move(embeddings[i]), source});
         }
-        return index_->search(query, emb);
+        index_->replace_path(path, docs);
+        return docs.size();
+    }
+
+    // ── Search ───────────────────────────────────────────────────────────────
+
+    // Without an `embedding`, the query is embedded with `embed` (else the
+    // store's embedder), and only if the index has no cached result for it.
+    std::vector<SearchResult> search(const std::string& query, const std::vector<float>& embedding = {},
+                                     const SearchFilter& filter = {}, const EmbeddingFn& embed = nullptr) {
+        if (!embedding.empty()) return index_->search(query, embedding, 10, filter);
+        const EmbeddingFn& fn = embed ? embed : embed_fn_;
+        return index_->search_query(query, [&]() {
+            return fn && !query.empty() ? fn(query) : std::vector<float>{};
+        }, 10, filter);
+    }
+
+    // ── Embedding changes ───────────────────────────────────────────────────
+
+    // Give documents stored under a previous embedding model or dimension
+    // vectors from the current one, in rate-limited batches. Blocks the
+    // calling fiber for one pass; returns the number re-embedded. Those the
+    // embedder failed on are left for the next call (at the latest, the next
+    // launch).
+    size_t reembed(const EmbeddingFn& embed = nullptr) {
+        const EmbeddingFn& fn = embed ? embed : embed_fn_;
+        if (!fn || !index_->reembed_pending()) return 0;
+        const auto& cfg = Config::instance();
+        size_t in_flight = (size_t)std::max(cfg.embedding_max_in_flight(), 1);
+        return index_->reembed([&](const std::vector<std::string>& texts) {
+            return embed_concurrently(fn, texts, in_flight);
+        }, (size_t)std::max(cfg.embedding_reembed_batch_size(), 1), cfg.embedding_reembed_max_per_sec());
     }
 
     // ── Indexing Session (Layer 1) ──────────────────────────────────────────
 
+    // Write-behind: on a fiber the message is queued and embedded and
+    // indexed in the background, so the caller never waits on the embedder.
+    // It is indexed inline only when the queue is full or there is no fiber,
+    // after the messages queued before it.
     void index_session_message(const std::string& session_id, const std::string& role, const std::string& content) {
-        std::vector<float> emb;
-        if (embed_fn_) emb = embed_fn_(content);
-        std::string id = "L1_" + session_id + "_" + std::to_string(std::time(nullptr));
-        index_->add_document(id, "session:" + session_id, 0, 0, "[" + role + "] " + content, emb, "sessions");
+        int64_t now = (int64_t)std::time(nullptr);
+        MemoryIndex::Doc doc{"L1_" + session_id + "_" + std::to_string(now), "session:" + session_id, 0, 0,
+                             "[" + role + "] " + content, {}, "sessions", now};
+        if (session_queue_->push(std::move(doc))) return;
+        session_queue_->flush();
+        if (embed_fn_) doc.embedding = embed_fn_(doc.text);
+        index_->add_documents(std::span<const MemoryIndex::Doc>(&doc, 1));
+    }
+
+    // Wait until every queued session message is in the index.
+    void flush_session_index() {
+        session_queue_->flush();
     }
 
     // ── Context for system prompt ─────────────────────────────────────────────
@@ -130,8 +202,44 @@ private:
     fs::path workspace_;
     fs::path memory_dir_;
     fs::path memory_file_;
-    std::unique_ptr<MemoryIndex> index_;
+    std::shared_ptr<MemoryIndex> index_; // shared with every store on this workspace
     EmbeddingFn embed_fn_;
+    std::shared_ptr<IndexQueue> session_queue_; // shared with its drain fiber
+
+    static MemoryIndexOptions index_options() {
+        const auto& cfg = Config::instance();
+        MemoryIndexOptions opts;
+        // Switching between the static and an HTTP provider re-embeds memory.
+        opts.embedding_model = cfg.embedding_provider() == "static" ? "static:" + cfg.embedding_static_model()
+                                                                    : cfg.embedding_model();
+        opts.index_type = cfg.index_type();
+        opts.hnsw_m = cfg.index_hnsw_m();
+        opts.hnsw_ef_construction = cfg.index_hnsw_ef_construction();
+        opts.hnsw_ef_search = cfg.index_hnsw_ef_search();
+        opts.ivf_nlist = cfg.index_ivf_nlist();
+        opts.ivf_nprobe = cfg.index_ivf_nprobe();
+        opts.pq_m = cfg.index_pq_m();
+        opts.pq_nbits = cfg.index_pq_nbits();
+        opts.ann_min_vectors = cfg.index_ann_min_vectors();
+        opts.vector_storage = cfg.index_vector_storage();
+        opts.rerank_factor = cfg.index_rerank_factor();
+        opts.wal_checkpoint_bytes = (uint64_t)cfg.index_wal_checkpoint_mb() << 20;
+        opts.wal_checkpoint_interval_sec = cfg.index_wal_checkpoint_interval_sec();
+        opts.keyword_commit_interval_ms = cfg.index_keyword_commit_interval_ms();
+        opts.search_threads = cfg.index_search_threads();
+        opts.shard_search_threads = cfg.index_shard_search_threads();
+        opts.search_cache_entries = cfg.index_search_cache_entries();
+        for (const auto& [source, days] : cfg.memory_decay_half_life_days()) {
+            opts.decay_half_life_days[source] = days;
+        }
+        opts.rrf_k = cfg.index_rrf_k();
+        opts.vector_weight = cfg.index_vector_weight();
+        opts.keyword_weight = cfg.index_keyword_weight();
+        opts.source_weights = cfg.index_source_weights();
+        opts.compact_tombstone_ratio = cfg.index_compact_tombstone_ratio();
+        opts.compact_min_tombstones = cfg.index_compact_min_tombstones();
+        return opts;
+    }
 
     static std::string read_file(const fs::path& p) {
         if (!fs::exists(p)) return "";
@@ -3,12 +3,23 @@
 #endif
 #include "memory_index.hpp"
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexScalarQuantizer.h>
 #include <faiss/index_io.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/utils/distances.h>
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <cstring>
 #include <fstream>
 #include <chrono>
 #include <ctime>
-#include <regex>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #ifdef USE_SQLITE
 #include <sqlite3.h>
 #else
@@ -25,16 +36,28 @@
 #include <lucene++/TopDocs.h>
 #include <lucene++/ScoreDoc.h>
 #include <lucene++/Term.h>
+#include <lucene++/TermQuery.h>
+#include <lucene++/BooleanQuery.h>
+#include <lucene++/PrefixQuery.h>
 #endif
 #include <filesystem>
 #include <spdlog/spdlog.h>
 #include <fiber.h>
 #include <mutex>
+#include <shared_mutex>
 #include <queue>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
 #include "fiber_pool.hpp"
+#include "vector_wal.hpp"
+#include "meta_store.hpp"
+#include "vector_file.hpp"
+#include "mapped_flat_index.hpp"
+#include "rank_fusion.hpp"
+#include "shard_index.hpp"
+#include "search_cache.hpp"
+#include <span>
 #include <functional>
 
 namespace fs = std::filesystem;
@@ -45,31 +68,134 @@ using namespace Lucene;
 struct MemoryIndex::Impl {
     std::string index_path;
     int dimension;
-    std::unique_ptr<faiss::IndexFlatIP> faiss_index;
-    std::vector<std::string> doc_ids;
+    MemoryIndexOptions options;
+
+    // The worker is the only writer. Reader threads search under a shared
+    // lock; the worker takes it exclusively only while it mutates
+    // faiss_index, ann_index or meta, never for I/O.
+    std::shared_mutex index_mutex;
+    std::unique_ptr<faiss::Index> faiss_index; // flat (fp32 or quantized), source of truth for rows
+
+    // Approximate index (HNSW / IVF-PQ). Built off-thread from a snapshot of
+    // faiss_index; the worker swaps it in under the exclusive lock once it
+    // has caught up, and reader threads search it under the shared lock.
+    std::shared_ptr<faiss::Index> ann_index;
+    faiss::idx_t ann_trained_rows = 0;
+    uint64_t ann_epoch = 0; // bumped by clear() to discard in-flight builds
+    std::thread ann_thread;
+    std::atomic<bool> ann_building{false};
+
+    // Quantized storage appends adds to faiss.wal; a checkpoint seals the log
+    // as faiss.wal.<seq>, rewrites faiss.index off-thread and then drops the
+    // sealed logs it covers. fp32 storage writes no log, since vectors.f32
+    // already holds every row: a checkpoint fsyncs it and meta.* off-thread.
+    std::unique_ptr<VectorWal> wal;
+    uint64_t wal_seq = 0;
+    uint64_t unsynced_bytes = 0; // fp32: vector bytes appended since the last checkpoint
+    std::thread checkpoint_thread;
+    std::atomic<bool> checkpointing{false};
+    std::chrono::steady_clock::time_point last_checkpoint = std::chrono::steady_clock::now();
+
+    // Every row at full precision, mmap'd. Under fp32 storage faiss_index is
+    // a MappedFlatIndex over it; under quantized storage the shortlist is
+    // re-scored from it.
+    std::unique_ptr<VectorFile> fp32_vectors;
+
+    // Row-aligned document metadata, so vector hits resolve without asking
+    // the keyword backend. Removed rows are tombstoned here, and it is the
+    // only record of each row's id.
+    std::unique_ptr<MetaStore> meta;
+
+    // Rows are positional, so documents are addressed by doc_key(id); an id
+    // can own several rows. Worker thread only; built when the worker starts
+    // so opening an index does not wait for it.
+    std::unordered_multimap<uint64_t, faiss::idx_t> live_rows;
+
+    // Rows grouped by month and source for decay-aware searches (fp32 storage
+    // with some decay configured). Built by the worker when it starts and
+    // after a compaction; until then searches take the plain scan.
+    ShardIndex shards;
+    bool shards_ready = false; // guarded by index_mutex
+
+    // Startup only: ids of rows the WAL replayed past the end of meta, for backfill_meta.
+    std::unordered_map<faiss::idx_t, std::string> recovered_ids;
+
+    // Compaction copies the live rows into *.compact files off-thread; the
+    // worker appends whatever arrived meanwhile and swaps them in.
+    std::thread compact_thread;
+    std::atomic<bool> compacting{false};
+    std::atomic<uint64_t> compact_epoch{0}; // bumped by clear() to discard in-flight builds
+
+    // After an embedding change, reembed() walks the keyword backend (SQLite
+    // by rowid, Lucene by doc number in one snapshot) and adds each document
+    // back as a vector row. `reembed.pending` marks an unfinished pass; after
+    // a restart the pass starts over, skipping documents that have vectors.
+    // A pass in which some documents got no vector ends with the marker kept,
+    // so the next reembed() retries just those.
+    std::atomic<bool> reembed_needed{false};
+    std::atomic<bool> reembed_running{false};
+    int64_t reembed_cursor = 0; // worker only, as is the rest
+    size_t reembed_failed = 0;  // documents of this pass whose embedding failed
+    std::unordered_map<uint64_t, std::string> reembed_inflight; // doc key -> path, handed out but not stored
+#ifdef USE_SQLITE
+    std::unordered_map<uint64_t, int64_t> reembed_rowids; // doc key -> documents rowid, for handed-out docs
+#else
+    IndexReaderPtr reembed_reader;
+    std::unordered_set<uint64_t> reembed_dropped_keys; // removed since the snapshot was taken
+    std::vector<std::string> reembed_dropped_paths;
+#endif
     
     // Search backend components
 #ifdef USE_SQLITE
-    sqlite3* db = nullptr;
+    // Text lives once, in `documents`; `documents_fts` is an external-content
+    // FTS5 index over it kept in sync by triggers.
+    std::string db_path;
+    sqlite3* db = nullptr; // worker connection; each reader opens its own
+    sqlite3_stmt* insert_stmt = nullptr;
+    sqlite3_stmt* delete_stmt = nullptr;
+    sqlite3_stmt* delete_path_stmt = nullptr;
 #else
     String lucene_path;
     AnalyzerPtr analyzer;
     DirectoryPtr directory;
+
+    // One writer for the life of the index. Searches use a near-real-time
+    // reader from the writer, refreshed only when the generation moves;
+    // commits are grouped on a timer instead of paid per document.
+    IndexWriterPtr writer;
+    IndexReaderPtr reader;
+    IndexSearcherPtr searcher;
+    std::mutex searcher_mutex; // guards reader / searcher / searcher_generation
+    std::atomic<uint64_t> lucene_generation{0};
+    uint64_t searcher_generation = 0;
+    bool lucene_dirty = false;
+    std::chrono::steady_clock::time_point last_commit = std::chrono::steady_clock::now();
 #endif
 
     // Service thread components
     struct Request {
-        enum Type { ADD, SEARCH, CLEAR } type;
-        std::string id, path, text, source;
-        int start_line, end_line;
-        std::vector<float> embedding;
+        enum Type { ADD, REMOVE, SEARCH, CLEAR, ANN_READY, COMPACT_READY, REEMBED_READ, REEMBED_STORE } type;
+        std::span<const MemoryIndex::Doc> docs; // owned by the blocked caller (ADD, REEMBED_STORE)
+        bool replace = false;                   // ADD: drop existing rows with the same ids first
+        std::string replace_path;               // ADD: drop every document under this path first
+        std::string doc_id;                     // REMOVE
         std::string query;
         std::vector<float> query_embedding;
         int top_k;
+        SearchFilter filter;
         fiber_t calling_fiber;
         FiberNode* calling_node;
         std::vector<SearchResult>* search_results = nullptr;
         std::function<void()> on_complete;
+        std::shared_ptr<faiss::Index> built_ann;
+        faiss::idx_t built_rows = 0;
+        uint64_t built_epoch = 0;
+        std::unique_ptr<faiss::Index> compacted;
+        std::unique_ptr<MetaStore> compacted_meta;
+        std::unique_ptr<VectorFile> compacted_vectors;
+        std::vector<faiss::idx_t> compacted_rows; // old row -> new row, -1 if dropped
+        std::vector<MemoryIndex::Doc>* reembed_batch = nullptr; // REEMBED_READ output
+        size_t limit = 0;
     };
 
     std::thread worker_thread;
@@ -78,84 +204,240 @@ struct MemoryIndex::Impl {
     std::condition_variable queue_cv;
     std::atomic<bool> running{true};
 
-    Impl(const std::string& path, int dim) : index_path(path), dimension(dim) {
+    // Searches have their own lane, so they never wait behind queued adds.
+    std::vector<std::thread> reader_threads;
+    std::queue<Request> search_queue; // guarded by queue_mutex
+    std::condition_variable search_cv;
+
+    // Bumped by the worker after every change a search could observe, before
+    // the writer is told it is done. Cached results from an older generation
+    // are never returned.
+    std::atomic<uint64_t> generation{0};
+    std::unique_ptr<SearchCache> cache; // null when disabled
+
+    // Helpers a sharded search fans out to, alongside its own reader thread.
+    std::vector<std::thread> shard_threads;
+    std::queue<std::function<void()>> shard_tasks; // guarded by shard_mutex
+    std::mutex shard_mutex;
+    std::condition_variable shard_cv;
+
+    // Keyword backend handles and search scratch owned by one thread.
+    struct ReadContext {
+#ifdef USE_SQLITE
+        sqlite3* db = nullptr;
+        sqlite3_stmt* match_stmt = nullptr; // prepared on first use
+        sqlite3_stmt* by_id_stmt = nullptr;
+        sqlite3_stmt* text_stmt = nullptr;
+        std::map<std::string, sqlite3_stmt*> filter_stmts; // one per filter shape
+#endif
+        RankFusion fusion;
+        std::vector<SearchResult> keyword_hits;
+        std::vector<float> distances;
+        std::vector<faiss::idx_t> labels;
+        std::vector<std::pair<float, faiss::idx_t>> rescored;
+        std::vector<uint8_t> bitmap; // one bit per row passing the filter
+        std::vector<uint8_t> path_ok;
+        std::vector<uint8_t> source_ok;
+        std::vector<int64_t> stamps;
+        std::vector<float> rates;
+        std::vector<float> factors;
+    };
+
+    // One sharded search, shared with the helpers it fans out to. Shards are
+    // claimed in `order` (best bound first) and each participant merges its
+    // candidates into `top`, a min-heap on decayed score.
+    struct ShardCandidate {
+        float score; // similarity * source weight * decay
+        float sim;
+        faiss::idx_t row;
+    };
+    struct ShardScan {
+        const float* query;
+        size_t k;
+        const uint8_t* bitmap; // filtered search, else nullptr
+        double now;
+        std::vector<uint32_t> order;
+        std::vector<float> bounds;
+        std::vector<std::pair<float, float>> policies; // per shard: weight, decay rate
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t next = 0;
+        int active = 0;
+        std::vector<ShardCandidate> top;
+    };
+    static constexpr uint32_t kVectorList = 0;
+    static constexpr uint32_t kKeywordList = 1;
+
+    // Hides tombstoned rows from Faiss searches.
+    struct LiveRowSelector : faiss::IDSelector {
+        const MetaStore* meta;
+        explicit LiveRowSelector(const MetaStore* m) : meta(m) {}
+        bool is_member(faiss::idx_t row) const override {
+            return (size_t)row < meta->size() && !meta->deleted(row);
+        }
+    };
+
+    // Queue a request and block the calling fiber (or thread) until the
+    // worker has completed it.
+    void submit(Request req);
+
+    // Call `start` with a completion callback, then block the calling fiber
+    // (or thread) until that callback runs, from any thread.
+    void await(const std::function<void(std::function<void()>)>& start);
+
+    // Serve a search from the cache, by joining an identical one in flight,
+    // or by running it. With `embedding` null, `embed` supplies it on a miss.
+    std::vector<SearchResult> cached_search(const std::string& query, const std::vector<float>* embedding,
+                                            const std::function<std::vector<float>()>* embed,
+                                            int top_k, const SearchFilter& filter);
+    std::vector<SearchResult> run_search(const std::string& query, const std::vector<float>& embedding,
+                                         int top_k, const SearchFilter& filter);
+
+    void enqueue(Request req) {
+        bool search = req.type == Request::SEARCH;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            (search ? search_queue : queue).push(std::move(req));
+        }
+        (search ? search_cv : queue_cv).notify_one();
+    }
+
+    Impl(const std::string& path, int dim, const MemoryIndexOptions& opts)
+        : index_path(path), dimension(dim), options(opts) {
         fs::create_directories(path);
-        
+        recover_compaction();
+        check_embedding();
+
+        // vectors.f32 is mapped, not read: under fp32 storage it is the whole
+        // flat index, so opening costs the same at any size.
+        fp32_vectors = std::make_unique<VectorFile>(fs::path(path) / "vectors.f32", dimension);
+
         fs::path faiss_path = fs::path(path) / "faiss.index";
         if (fs::exists(faiss_path)) {
             try {
-                faiss::Index* idx = faiss::read_index(faiss_path.string().c_str());
-                faiss_index.reset(dynamic_cast<faiss::IndexFlatIP*>(idx));
-                if (faiss_index && faiss_index->d != dimension) {
-                    spdlog::warn("Faiss index dimension mismatch: found {}, expected {}. Resetting index.", faiss_index->d, dimension);
-                    faiss_index.reset();
+                std::unique_ptr<faiss::Index> loaded(faiss::read_index(faiss_path.string().c_str()));
+                if (loaded->d != dimension) {
+                    spdlog::warn("Faiss index dimension mismatch: found {}, expected {}. Resetting index.", loaded->d, dimension);
+                    fp32_vectors->reset();
+                    fs::remove(faiss_path);
+                } else if (!quantized()) {
+                    adopt_checkpoint(loaded.get());
+                } else {
+                    faiss_index = std::move(loaded);
+                    if (!storage_matches(faiss_index.get())) convert_storage();
                 }
             } catch (...) {
                 spdlog::warn("Failed to load Faiss index from {}", faiss_path.string());
+                faiss_index.reset();
             }
         }
         
         if (!faiss_index) {
-            faiss_index = std::make_unique<faiss::IndexFlatIP>(dimension);
+            faiss_index = new_flat_index(fp32_vectors.get());
         }
+        if (quantized()) encode_vectors();
 
-        fs::path ids_path = fs::path(path) / "doc_ids.txt";
-        if (fs::exists(ids_path)) {
-            std::ifstream f(ids_path);
-            std::string line;
-            while (std::getline(f, line)) {
-                if (!line.empty()) doc_ids.push_back(line);
-            }
-        }
+        meta = std::make_unique<MetaStore>(fs::path(path));
+        replay_wal();
+        if (quantized()) sync_vectors();
+        meta->truncate(faiss_index->ntotal);
+
+        load_ann_index();
         
 #ifdef USE_SQLITE
-        std::string db_path = path + "/index.db";
+        db_path = path + "/index.db";
         if (sqlite3_open(db_path.c_str(), &db) != SQLITE_OK) {
             spdlog::error("Failed to open SQLite database: {}", sqlite3_errmsg(db));
         } else {
-            const char* sql = "CREATE VIRTUAL TABLE IF NOT EXISTS docs USING fts5(id UNINDEXED, path UNINDEXED, text, start_line UNINDEXED, end_line UNINDEXED, source UNINDEXED);";
-            char* err_msg = nullptr;
-            if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
-                spdlog::error("Failed to create FTS5 table: {}", err_msg);
-                sqlite3_free(err_msg);
-            }
+            open_sqlite_schema();
         }
 #else
         lucene_path = StringUtils::toUnicode(path + "/lucene");
         fs::create_directories(path + "/lucene");
         analyzer = newLucene<StandardAnalyzer>(LuceneVersion::LUCENE_CURRENT);
         directory = FSDirectory::open(lucene_path);
+        try {
+            // We are the only writer; a lock left behind by a crash is stale.
+            if (IndexWriter::isLocked(directory)) IndexWriter::unlock(directory);
+            bool create = !IndexReader::indexExists(directory);
+            writer = newLucene<IndexWriter>(directory, analyzer, create, IndexWriter::MaxFieldLengthLIMITED);
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to open Lucene writer: {}", e.what());
+        }
 #endif
 
+        init_source_policies();
+        backfill_meta();
+        if (options.search_cache_entries > 0) cache = std::make_unique<SearchCache>((size_t)options.search_cache_entries);
+
         worker_thread = std::thread(&Impl::worker_loop, this);
+        for (int i = 0; i < std::max(1, options.search_threads); ++i) {
+            reader_threads.emplace_back(&Impl::reader_loop, this);
+        }
+        for (int i = 0; i < options.shard_search_threads; ++i) {
+            shard_threads.emplace_back(&Impl::shard_loop, this);
+        }
     }
 
     ~Impl() {
         running = false;
         queue_cv.notify_all();
+        search_cv.notify_all();
+        for (auto& t : reader_threads) t.join();
+        shard_cv.notify_all();
+        for (auto& t : shard_threads) t.join();
         if (worker_thread.joinable()) worker_thread.join();
+        if (ann_thread.joinable()) ann_thread.join();
+        if (checkpoint_thread.joinable()) checkpoint_thread.join();
+        if (compact_thread.joinable()) compact_thread.join();
 #ifdef USE_SQLITE
+        sqlite3_finalize(insert_stmt);
+        sqlite3_finalize(delete_stmt);
+        sqlite3_finalize(delete_path_stmt);
         if (db) sqlite3_close(db);
+#else
+        try {
+            if (reader) reader->close();
+            if (writer) writer->close(); // commits anything still buffered
+        } catch (const std::exception& e) {
+            spdlog::warn("Lucene close failed: {}", e.what());
+        }
 #endif
     }
 
     void clear_internal() {
-        faiss_index = std::make_unique<faiss::IndexFlatIP>(dimension);
-        doc_ids.clear();
+        std::unique_lock<std::shared_mutex> lock(index_mutex);
+        fp32_vectors->reset();
+        faiss_index = new_flat_index(fp32_vectors.get());
+        ann_index.reset();
+        ann_trained_rows = 0;
+        ++ann_epoch;
+        ++compact_epoch; // under the lock, so a compaction build stops before meta is reset
+        live_rows.clear();
+        shards.clear();
+        finish_reembed(); // nothing is left to re-embed
+
+        // Let an in-flight checkpoint land first so it cannot resurrect the files.
+        if (checkpoint_thread.joinable()) checkpoint_thread.join();
+        for (const auto& [seq, sealed] : sealed_wals()) fs::remove(sealed);
+        wal->reset();
+        meta->reset();
+        lock.unlock();
         
         fs::remove(fs::path(index_path) / "faiss.index");
-        fs::remove(fs::path(index_path) / "doc_ids.txt");
+        fs::remove(fs::path(index_path) / "faiss_ann.index");
         
 #ifdef USE_SQLITE
         if (db) {
-            sqlite3_exec(db, "DELETE FROM docs;", nullptr, nullptr, nullptr);
+            sqlite3_exec(db, "DELETE FROM documents;", nullptr, nullptr, nullptr);
         }
 #else
         try {
-            if (directory && analyzer) {
-                IndexWriterPtr writer = newLucene<IndexWriter>(directory, analyzer, false, IndexWriter::MaxFieldLengthLIMITED);
+            if (writer) {
                 writer->deleteAll();
-                writer->close();
+                writer->commit();
+                ++lucene_generation;
+                lucene_dirty = false;
             }
         } catch (const std::exception& e) {
             spdlog::warn("Lucene clear failed: {}", e.what());
@@ -166,203 +448,480 @@ struct MemoryIndex::Impl {
     }
 
     void worker_loop() {
+        rebuild_live_rows();
+        rebuild_shards();
         while (running) {
-            Request req;
+            std::queue<Request> pending;
             {
                 std::unique_lock<std::mutex> lock(queue_mutex);
-                queue_cv.wait(lock, [this] { return !queue.empty() || !running; });
+                bool ready = queue_cv.wait_for(lock, std::chrono::seconds(1), [this] { return !queue.empty() || !running; });
                 if (!running && queue.empty()) break;
-                req = std::move(queue.front());
-                queue.pop();
+                if (!ready) {
+                    lock.unlock();
+                    on_idle();
+                    continue;
+                }
+                // Take everything queued so consecutive adds share one commit.
+                std::swap(pending, queue);
+            }
+
+            std::vector<Request> batch;
+            while (!pending.empty()) {
+                Request req = std::move(pending.front());
+                pending.pop();
+                if (req.type == Request::ADD) {
+                    batch.push_back(std::move(req));
+                    if (!pending.empty() && pending.front().type == Request::ADD) continue;
+                    process_add_batch(batch);
+                    batch.clear();
+                } else {
+                    process(req);
+                }
+            }
+        }
+    }
+
+    void shard_loop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(shard_mutex);
+                shard_cv.wait(lock, [this] { return !shard_tasks.empty() || !running; });
+                if (shard_tasks.empty()) break;
+                task = std::move(shard_tasks.front());
+                shard_tasks.pop();
+            }
+            task();
+        }
+    }
+
+    void reader_loop() {
+        ReadContext ctx;
+#ifdef USE_SQLITE
+        if (sqlite3_open_v2(db_path.c_str(), &ctx.db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+            spdlog::warn("Failed to open SQLite reader connection: {}", sqlite3_errmsg(ctx.db));
+            sqlite3_close(ctx.db);
+            ctx.db = nullptr;
+        } else {
+            sqlite3_busy_timeout(ctx.db, 5000);
+        }
+#endif
+        while (true) {
+            Request req;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                search_cv.wait(lock, [this] { return !search_queue.empty() || !running; });
+                if (search_queue.empty()) break;
+                req = std::move(search_queue.front());
+                search_queue.pop();
             }
 
             try {
-                switch (req.type) {
-                case Request::ADD:
-                    add_doc_internal(req.id, req.path, req.start_line, req.end_line, req.text, req.embedding, req.source);
-                    break;
-                case Request::SEARCH:
-                    if (req.search_results) {
-                        *req.search_results = search_internal(req.query, req.query_embedding, req.top_k);
-                    }
-                    break;
-                case Request::CLEAR:
-                    clear_internal();
-                    break;
+                if (req.search_results) {
+                    *req.search_results = search_internal(ctx, req.query, req.query_embedding, req.top_k, req.filter);
                 }
             } catch (const std::exception& e) {
-                spdlog::error("Exception in MemoryIndex worker thread: {}", e.what());
+                spdlog::error("Exception in MemoryIndex search: {}", e.what());
             } catch (...) {
-                spdlog::error("Unknown exception in MemoryIndex worker thread");
+                spdlog::error("Unknown exception in MemoryIndex search");
             }
+            if (req.on_complete) req.on_complete();
+        }
+#ifdef USE_SQLITE
+        finalize_read_stmts(ctx);
+        if (ctx.db) sqlite3_close(ctx.db);
+#endif
+    }
+
+    void process(Request& req) {
+        try {
+            switch (req.type) {
+            case Request::ADD:
+                break;
+            case Request::REMOVE:
+                remove_internal({req.doc_id});
+                break;
+            case Request::SEARCH:
+                break; // served by reader_loop
 
-            if (req.on_complete) {
-                req.on_complete();
+            case Request::CLEAR:
+                clear_internal();
+                break;
+            case Request::ANN_READY:
+                install_ann(req);
+                break;
+            case Request::COMPACT_READY:
+                install_compaction(req);
+                break;
+            case Request::REEMBED_READ:
+                read_reembed_batch(req);
+                break;
+            case Request::REEMBED_STORE:
+                store_reembed_batch(req);
+                break;
             }
+        } catch (const std::exception& e) {
+            spdlog::error("Exception in MemoryIndex worker thread: {}", e.what());
+        } catch (...) {
+            spdlog::error("Unknown exception in MemoryIndex worker thread");
+        }
+        if (req.type != Request::REEMBED_READ) ++generation; // an installed ANN index or compaction can change results too
+
+        if (req.on_complete) {
+            req.on_complete();
         }
     }
 
-    void add_doc_internal(
-        const std::string& id,
-        const std::string& path,
-        int start_line,
-        int end_line,
-        const std::string& text,
-        const std::vector<float>& embedding,
-        const std::string& source
-    ) {
-        // 1. Add to Faiss
-        if ((int)embedding.size() == dimension) {
-            faiss_index->add(1, embedding.data());
-            doc_ids.push_back(id);
-            
-            // Persist Faiss
-            try {
-                fs::path faiss_path = fs::path(index_path) / "faiss.index";
-                faiss::write_index(faiss_index.get(), faiss_path.string().c_str());
-                
-                fs::path ids_path = fs::path(index_path) / "doc_ids.txt";
-                std::ofstream f(ids_path, std::ios::app);
-                if (f.is_open()) f << id << "\n";
-            } catch (...) {
-                spdlog::warn("Failed to persist Faiss index");
+    void process_add_batch(std::vector<Request>& batch) {
+        std::vector<const MemoryIndex::Doc*> docs;
+        try {
+            for (const auto& req : batch) {
+                if (req.replace) {
+                    std::vector<std::string> ids;
+                    for (const auto& doc : req.docs) ids.push_back(doc.id);
+                    // Earlier requests in the batch may add an id this one replaces.
+                    bool overlaps = std::any_of(docs.begin(), docs.end(), [&](const MemoryIndex::Doc* d) {
+                        return std::find(ids.begin(), ids.end(), d->id) != ids.end();
+                    });
+                    if (overlaps) {
+                        add_docs_internal(docs);
+                        docs.clear();
+                    }
+                    remove_internal(ids);
+                }
+                if (!req.replace_path.empty()) {
+                    bool overlaps = std::any_of(docs.begin(), docs.end(), [&](const MemoryIndex::Doc* d) {
+                        return d->path == req.replace_path;
+                    });
+                    if (overlaps) {
+                        add_docs_internal(docs);
+                        docs.clear();
+                    }
+                    remove_path_internal(req.replace_path);
+                }
+                for (const auto& doc : req.docs) docs.push_back(&doc);
             }
+            add_docs_internal(docs);
+        } catch (const std::exception& e) {
+            spdlog::error("Exception in MemoryIndex worker thread: {}", e.what());
+        } catch (...) {
+            spdlog::error("Unknown exception in MemoryIndex worker thread");
+        }
+        ++generation;
+
+        for (auto& req : batch) {
+            if (req.on_complete) req.on_complete();
+        }
+    }
+
+    // Periodic work driven by the worker's wait timeout.
+    void on_idle() {
+        maybe_checkpoint();
+        maybe_compact();
+#ifndef USE_SQLITE
+        maybe_commit_keyword(false);
+#endif
+    }
+
+    // With `keyword` false only vector rows are added (the keyword backend
+    // has the documents already; under SQLite, at `text_rowids`).
+    void add_docs_internal(const std::vector<const MemoryIndex::Doc*>& docs, bool keyword = true,
+                           std::vector<int64_t> text_rowids = {}) {
+        if (docs.empty()) return;
+
+        // Resolve each document's date once; searches only read the epoch.
+        std::vector<int64_t> stamps(docs.size());
+        for (size_t i = 0; i < docs.size(); ++i) {
+            stamps[i] = docs[i]->timestamp ? docs[i]->timestamp : date_from_path(docs[i]->path);
         }
 
-        // 2. Add to Search Backend
 #ifdef USE_SQLITE
-        if (!db) return;
-        const char* sql = "INSERT INTO docs(id, path, text, start_line, end_line, source) VALUES(?, ?, ?, ?, ?, ?);";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 2, path.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt, 3, text.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt, 4, start_line);
-            sqlite3_bind_int(stmt, 5, end_line);
-            sqlite3_bind_text(stmt, 6, source.c_str(), -1, SQLITE_TRANSIENT);
-            
-            if (sqlite3_step(stmt) != SQLITE_DONE) {
-                spdlog::warn("SQLite insert failed: {}", sqlite3_errmsg(db));
+        // The documents table is the text's only home, so it is written
+        // first and meta records the rowid instead of a copy.
+        if (keyword) text_rowids = insert_documents(docs, stamps);
+#endif
+        text_rowids.resize(docs.size(), -1);
+
+        // Add to Faiss: one WAL flush and one add() for the whole batch
+        std::vector<float> vectors;
+        std::vector<size_t> added;
+        vectors.reserve(docs.size() * dimension);
+        for (size_t i = 0; i < docs.size(); ++i) {
+            const auto* doc = docs[i];
+            if ((int)doc->embedding.size() != dimension) continue;
+            // Quantized codes persist via the WAL; faiss.index is only
+            // rewritten by checkpoints. fp32 rows go straight to vectors.f32.
+            if (quantized()) wal->append(faiss_index->ntotal + added.size(), doc->id, doc->embedding.data(), dimension);
+            vectors.insert(vectors.end(), doc->embedding.begin(), doc->embedding.end());
+            added.push_back(i);
+        }
+        faiss::idx_t n = (faiss::idx_t)added.size();
+        if (n > 0) {
+            wal->flush();
+            {
+                std::unique_lock<std::shared_mutex> lock(index_mutex);
+                faiss_index->add(n, vectors.data()); // fp32: appends to vectors.f32
+                if (ann_index) {
+                    ann_index->add(n, vectors.data());
+                }
+                if (quantized()) {
+                    fp32_vectors->append(vectors.data(), n);
+                    fp32_vectors->flush();
+                } else {
+                    unsynced_bytes += (uint64_t)n * dimension * sizeof(float);
+                }
+                for (size_t j = 0; j < added.size(); ++j) {
+                    const auto* doc = docs[added[j]];
+                    size_t row = meta->size();
+                    live_rows.emplace(doc_key(doc->id), (faiss::idx_t)row);
+                    int64_t text_rowid = doc->text.empty() ? -1 : text_rowids[added[j]];
+                    meta->append(doc->id, doc->path, doc->start_line, doc->end_line, doc->text, doc->source,
+                                 stamps[added[j]], text_rowid);
+                    if (shards_ready) {
+                        float norm = std::sqrt(faiss::fvec_norm_L2sqr(vectors.data() + j * dimension, dimension));
+                        shards.add((int64_t)row, meta->source_index(row), meta->timestamp(row), norm);
+                    }
+                }
+                meta->flush();
             }
-            sqlite3_finalize(stmt);
-        } else {
-            spdlog::warn("SQLite prepare failed: {}", sqlite3_errmsg(db));
+            maybe_checkpoint();
+            maybe_rebuild_ann();
         }
-#else
+#ifndef USE_SQLITE
+        if (!keyword) return;
+
+        // Add to the keyword backend
         try {
-            if (!directory || !analyzer) return;
+            if (!writer) return;
 
-            bool create = !IndexReader::indexExists(directory);
-            IndexWriterPtr writer = newLucene<IndexWriter>(directory, analyzer, create, IndexWriter::MaxFieldLengthLIMITED);
-
-            DocumentPtr doc = newLucene<Document>();
-            doc->add(newLucene<Field>(StringUtils::toUnicode("id"), StringUtils::toUnicode(id), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(StringUtils::toUnicode("path"), StringUtils::toUnicode(path), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(StringUtils::toUnicode("text"), StringUtils::toUnicode(text), Field::STORE_YES, Field::INDEX_ANALYZED));
-            doc->add(newLucene<Field>(StringUtils::toUnicode("start_line"), StringUtils::toUnicode(std::to_string(start_line)), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(StringUtils::toUnicode("end_line"), StringUtils::toUnicode(std::to_string(end_line)), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-            doc->add(newLucene<Field>(StringUtils::toUnicode("source"), StringUtils::toUnicode(source), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
-
-            writer->addDocument(doc);
-            writer->close();
+            for (size_t i = 0; i < docs.size(); ++i) {
+                const auto* d = docs[i];
+                DocumentPtr doc = newLucene<Document>();
+                doc->add(newLucene<Field>(StringUtils::toUnicode("id"), StringUtils::toUnicode(d->id), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+                doc->add(newLucene<Field>(StringUtils::toUnicode("path"), StringUtils::toUnicode(d->path), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+                doc->add(newLucene<Field>(StringUtils::toUnicode("text"), StringUtils::toUnicode(d->text), Field::STORE_YES, Field::INDEX_ANALYZED));
+                doc->add(newLucene<Field>(StringUtils::toUnicode("start_line"), StringUtils::toUnicode(std::to_string(d->start_line)), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+                doc->add(newLucene<Field>(StringUtils::toUnicode("end_line"), StringUtils::toUnicode(std::to_string(d->end_line)), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+                doc->add(newLucene<Field>(StringUtils::toUnicode("source"), StringUtils::toUnicode(d->source), Field::STORE_YES, Field::INDEX_NOT_ANALYZED));
+                doc->add(newLucene<Field>(StringUtils::toUnicode("timestamp"), StringUtils::toUnicode(std::to_string(stamps[i])), Field::STORE_YES, Field::INDEX_NO));
+                writer->addDocument(doc);
+            }
+            ++lucene_generation;
+            lucene_dirty = true;
+            maybe_commit_keyword(false);
         } catch (...) {
             spdlog::warn("Lucene add_doc failed");
         }
 #endif
     }
 
-    std::vector<SearchResult> search_internal(
-        const std::string& query,
-        const std::vector<float>& query_embedding,
-        int top_k
-    ) {
-        std::map<std::string, float> vector_scores;
-        std::map<std::string, float> text_scores;
-        std::map<std::string, SearchResult> metadata;
+#ifdef USE_SQLITE
+    // Insert into the keyword backend, returning each document's rowid (-1
+    // where the insert failed).
+    std::vector<int64_t> insert_documents(const std::vector<const MemoryIndex::Doc*>& docs, const std::vector<int64_t>& stamps) {
+        std::vector<int64_t> rowids(docs.size(), -1);
+        if (!db) return rowids;
+        const char* sql = "INSERT INTO documents(id, path, text, start_line, end_line, source, timestamp) VALUES(?, ?, ?, ?, ?, ?, ?);";
+        if (sqlite3_stmt* stmt = cached_stmt(db, insert_stmt, sql)) {
+            sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+            for (size_t i = 0; i < docs.size(); ++i) {
+                const auto* doc = docs[i];
+                sqlite3_bind_text(stmt, 1, doc->id.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 2, doc->path.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_text(stmt, 3, doc->text.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_int(stmt, 4, doc->start_line);
+                sqlite3_bind_int(stmt, 5, doc->end_line);
+                sqlite3_bind_text(stmt, 6, doc->source.c_str(), -1, SQLITE_STATIC);
+                sqlite3_bind_int64(stmt, 7, stamps[i]);
+                
+                if (sqlite3_step(stmt) == SQLITE_DONE) {
+                    rowids[i] = sqlite3_last_insert_rowid(db);
+                } else {
+                    spdlog::warn("SQLite insert failed: {}", sqlite3_errmsg(db));
+                }
+                sqlite3_reset(stmt);
+            }
+            sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+        }
+        return rowids;
+    }
+#endif
 
-        // 1. Vector Search
-        if ((int)query_embedding.size() == dimension && faiss_index->ntotal > 0) {
-            int candidate_k = top_k * 4; // Candidate multiplier
-            std::vector<float> distances(candidate_k);
-            std::vector<faiss::idx_t> labels(candidate_k);
-            
-            // Note: Faiss IndexFlatIP returns inner product.
-            // If vectors are normalized, this is cosine similarity.
-            faiss_index->search(1, query_embedding.data(), candidate_k, distances.data(), labels.data());
+    void remove_internal(const std::vector<std::string>& ids) {
+        if (ids.empty()) return;
+
+        // 1. Tombstone the vector rows; they stay in Faiss until compaction
+        size_t removed = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(index_mutex);
+            for (const auto& id : ids) {
+                auto [it, end] = live_rows.equal_range(doc_key(id));
+                while (it != end) {
+                    if (meta->id(it->second) != id) {
+                        ++it;
+                        continue;
+                    }
+                    meta->remove(it->second);
+                    it = live_rows.erase(it);
+                    ++removed;
+                }
+            }
+            meta->flush();
+        }
+        for (const auto& id : ids) {
+            reembed_inflight.erase(doc_key(id));
+#ifndef USE_SQLITE
+            if (reembed_reader) reembed_dropped_keys.insert(doc_key(id));
+#endif
+        }
+
+        // 2. Delete from Search Backend
+#ifdef USE_SQLITE
+        if (db) {
+            if (sqlite3_stmt* stmt = cached_stmt(db, delete_stmt, "DELETE FROM documents WHERE id = ?;")) {
+                sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+                for (const auto& id : ids) {
+                    sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+                    if (sqlite3_step(stmt) != SQLITE_DONE) {
+                        spdlog::warn("SQLite delete failed: {}", sqlite3_errmsg(db));
+                    }
+                    sqlite3_reset(stmt);
+                }
+                sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+            }
+        }
+#else
+        try {
+            if (writer) {
+                for (const auto& id : ids) {
+                    writer->deleteDocuments(newLucene<Term>(StringUtils::toUnicode("id"), StringUtils::toUnicode(id)));
+                }
+                ++lucene_generation;
+                lucene_dirty = true;
+                maybe_commit_keyword(false);
+            }
+        } catch (...) {
+            spdlog::warn("Lucene delete failed");
+        }
+#endif
+
+        if (removed > 0) maybe_compact();
+    }
+
+    void remove_path_internal(const std::string& path) {
+        // 1. Tombstone the path's vector rows
+        size_t removed = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock(index_mutex);
+            for (size_t row : meta->remove_path(path)) {
+                auto [it, end] = live_rows.equal_range(meta->key(row));
+                for (; it != end; ++it) {
+                    if (it->second == (faiss::idx_t)row) {
+                        live_rows.erase(it);
+                        break;
+                    }
+                }
+                ++removed;
+            }
+            if (removed > 0) meta->flush();
+        }
+        std::erase_if(reembed_inflight, [&](const auto& entry) { return entry.second == path; });
+#ifndef USE_SQLITE
+        if (reembed_reader) reembed_dropped_paths.push_back(path);
+#endif
 
-            for (int i = 0; i < candidate_k; ++i) {
-                if (labels[i] >= 0 && labels[i] < (faiss::idx_t)doc_ids.size()) {
-                    std::string id = doc_ids[labels[i]];
-                    vector_scores[id] = distances[i];
-                    // Metadata placeholder for now, will be filled by Lucene or if not present
+        // 2. Delete from Search Backend; this also covers documents that were
+        // indexed without an embedding and so never got a vector row.
+#ifdef USE_SQLITE
+        if (db) {
+            if (sqlite3_stmt* stmt = cached_stmt(db, delete_path_stmt, "DELETE FROM documents WHERE path = ?;")) {
+                sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_STATIC);
+                if (sqlite3_step(stmt) != SQLITE_DONE) {
+                    spdlog::warn("SQLite delete failed: {}", sqlite3_errmsg(db));
                 }
+                sqlite3_reset(stmt);
+            }
+        }
+#else
+        try {
+            if (writer) {
+                writer->deleteDocuments(newLucene<Term>(StringUtils::toUnicode("path"), StringUtils::toUnicode(path)));
+                ++lucene_generation;
+                lucene_dirty = true;
+                maybe_commit_keyword(false);
             }
+        } catch (...) {
+            spdlog::warn("Lucene delete failed");
         }
+#endif
+
+        if (removed > 0) maybe_compact();
+    }
+
+    std::vector<SearchResult> search_internal(
+        ReadContext& ctx,
+        const std::string& query,
+        const std::vector<float>& query_embedding,
+        int top_k,
+        const SearchFilter& filter
+    ) {
+        const int candidate_k = top_k * 4; // Candidate multiplier
+        std::vector<SearchResult>& keyword_hits = ctx.keyword_hits;
+        keyword_hits.clear();
 
-        // 2. Keyword Search
+        // 1. Keyword Search (no index lock needed)
         if (!query.empty()) {
 #ifdef USE_SQLITE
+            sqlite3* db = ctx.db;
             if (db) {
-                const char* sql = "SELECT id, path, text, start_line, end_line, source FROM docs WHERE docs MATCH ? ORDER BY rank LIMIT ?;";
-                sqlite3_stmt* stmt;
-                if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-                    sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_TRANSIENT);
-                    sqlite3_bind_int(stmt, 2, top_k * 4);
-                    
-                    int i = 0;
+                sqlite3_stmt* stmt = nullptr;
+                if (filter.empty()) {
+                    const char* sql =
+                        "SELECT d.id, d.path, d.text, d.start_line, d.end_line, d.source, d.timestamp"
+                        " FROM (SELECT rowid, rank FROM documents_fts WHERE documents_fts MATCH ? ORDER BY rank LIMIT ?) f"
+                        " JOIN documents d ON d.rowid = f.rowid ORDER BY f.rank;";
+                    if ((stmt = cached_stmt(db, ctx.match_stmt, sql))) {
+                        sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_STATIC);
+                        sqlite3_bind_int(stmt, 2, candidate_k);
+                    }
+                } else {
+                    stmt = filtered_match_stmt(ctx, query, filter, candidate_k);
+                }
+                if (stmt) {
                     while (sqlite3_step(stmt) == SQLITE_ROW) {
-                        std::string id = (const char*)sqlite3_column_text(stmt, 0);
-                        text_scores[id] = 1.0f / (1.0f + (float)i++);
-                        
-                        if (metadata.find(id) == metadata.end()) {
-                            metadata[id] = {
-                                id,
-                                (const char*)sqlite3_column_text(stmt, 1),
-                                sqlite3_column_int(stmt, 3),
-                                sqlite3_column_int(stmt, 4),
-                                (const char*)sqlite3_column_text(stmt, 2),
-                                0.0f,
-                                (const char*)sqlite3_column_text(stmt, 5)
-                            };
-                        }
+                        keyword_hits.push_back({
+                            (const char*)sqlite3_column_text(stmt, 0),
+                            (const char*)sqlite3_column_text(stmt, 1),
+                            sqlite3_column_int(stmt, 3),
+                            sqlite3_column_int(stmt, 4),
+                            (const char*)sqlite3_column_text(stmt, 2),
+                            0.0f,
+                            (const char*)sqlite3_column_text(stmt, 5),
+                            sqlite3_column_int64(stmt, 6)
+                        });
                     }
-                    sqlite3_finalize(stmt);
+                    sqlite3_reset(stmt);
                 }
             }
 #else
             try {
-                IndexReaderPtr reader = IndexReader::open(directory);
-                if (reader) {
-                    IndexSearcherPtr searcher = newLucene<IndexSearcher>(reader);
+                PinnedSearcher pinned = acquire_searcher();
+                if (IndexSearcherPtr searcher = pinned.searcher) {
                     QueryParserPtr parser = newLucene<QueryParser>(LuceneVersion::LUCENE_CURRENT, StringUtils::toUnicode("text"), analyzer);
                     QueryPtr lucene_query = parser->parse(StringUtils::toUnicode(query));
-                    
-                    int candidate_k = top_k * 4;
-                    TopDocsPtr top_docs = searcher->search(lucene_query, candidate_k);
+                    if (!filter.empty()) lucene_query = filtered_query(lucene_query, filter);
+                    // Timestamps are stored but not indexed, so a time range is
+                    // applied to the hits; fetch extra to make up for it.
+                    bool timed = filter.since || filter.until;
+                    TopDocsPtr top_docs = searcher->search(lucene_query, timed ? candidate_k * 4 : candidate_k);
 
-                    for (int i = 0; i < (int)top_docs->scoreDocs.size(); ++i) {
-                        ScoreDocPtr score_doc = top_docs->scoreDocs[i];
-                        DocumentPtr doc = searcher->doc(score_doc->doc);
+                    for (int i = 0; i < (int)top_docs->scoreDocs.size() && (int)keyword_hits.size() < candidate_k; ++i) {
+                        DocumentPtr doc = searcher->doc(top_docs->scoreDocs[i]->doc);
                         std::string id = StringUtils::toUTF8(doc->get(StringUtils::toUnicode("id")));
-                        
-                        // Reciprocal rank scoring for text matches
-                        text_scores[id] = 1.0f / (1.0f + (float)i);
-
-                        // Store metadata if not already there (vector search might have missed it or vice versa)
-                        if (metadata.find(id) == metadata.end()) {
-                            metadata[id] = {
-                                id,
-                                StringUtils::toUTF8(doc->get(StringUtils::toUnicode("path"))),
-                                std::stoi(StringUtils::toUTF8(doc->get(StringUtils::toUnicode("start_line")))),
-                                std::stoi(StringUtils::toUTF8(doc->get(StringUtils::toUnicode("end_line")))),
-                                StringUtils::toUTF8(doc->get(StringUtils::toUnicode("text"))),
-                                0.0f,
-                                StringUtils::toUTF8(doc->get(StringUtils::toUnicode("source")))
-                            };
-                        }
+                        SearchResult hit = lucene_result(id, doc);
+                        if (timed && !filter.matches_time(hit.timestamp)) continue;
+                        keyword_hits.push_back(std::move(hit));
                     }
-                    reader->close();
                 }
             } catch (...) {
                 spdlog::warn("Lucene search failed");
@@ -370,271 +929,1623 @@ struct MemoryIndex::Impl {
 #endif
         }
 
-        // 3. Fusion & Decay
-        std::vector<SearchResult> results;
-        
-        // We need to fetch metadata for items found only in vector search
-        // In a real implementation, we'd store metadata in a DB or keep it in memory
-        // For now, if metadata is missing, we try to fetch it from Lucene by ID
-        for (auto const& [id, vec_score] : vector_scores) {
-            if (metadata.find(id) == metadata.end()) {
-                fetch_metadata_from_backend(id, metadata);
-            }
+        RankFusion& fusion = ctx.fusion;
+        fusion.reset(options.rrf_k, candidate_k * 2);
+        for (int i = 0; i < (int)keyword_hits.size(); ++i) {
+            fusion.add(doc_key(keyword_hits[i].id), kKeywordList, i, options.keyword_weight).keyword = i;
         }
 
-        float vec_weight = 0.7f;
-        float text_weight = 0.3f;
-        double lambda = std::log(2.0) / 30.0; // 30-day half-life
-
-        for (auto const& [id, res_meta] : metadata) {
-            float v = vector_scores.count(id) ? vector_scores.at(id) : 0.0f;
-            float t = text_scores.count(id) ? text_scores.at(id) : 0.0f;
-            
-            float final_score = (vec_weight * v) + (text_weight * t);
+        // 2. Vector Search. Metadata for vector rows lives in meta, so the
+        // whole fusion runs under the shared lock.
+        std::shared_lock<std::shared_mutex> index_lock(index_mutex);
+        if ((int)query_embedding.size() == dimension && faiss_index->ntotal > 0) {
+            // Quantized codes only pick a wider shortlist; the exact vectors rank it.
+            int shortlist_k = quantized() ? candidate_k * std::max(1, options.rerank_factor) : candidate_k;
+            ctx.distances.resize(shortlist_k);
+            ctx.labels.resize(shortlist_k);
             
-            // Apply Temporal Decay for daily logs
-            final_score *= apply_temporal_decay(res_meta.path, lambda);
+            // Note: Faiss IndexFlatIP returns inner product.
+            // If vectors are normalized, this is cosine similarity.
+            // The ANN index covers every row once installed, so it can replace the scan.
+            faiss::Index* index = ann_index ? ann_index.get() : faiss_index.get();
+            size_t matched = 0;
+            if (!filter.empty()) {
+                // Pre-filter: Faiss only scores rows set in the bitmap.
+                matched = filter_rows(ctx, filter);
+                // Graph and IVF search lose recall when few rows pass; scanning
+                // those few is cheap, so use the flat index instead.
+                if (matched * 10 < (size_t)faiss_index->ntotal) index = faiss_index.get();
+            }
+            if (!filter.empty() && matched == 0) {
+                std::fill(ctx.labels.begin(), ctx.labels.end(), -1);
+            } else if (index == faiss_index.get() && shards_ready && shards.size() > 1) {
+                search_shards(ctx, query_embedding.data(), shortlist_k, filter.empty() ? nullptr : ctx.bitmap.data());
+            } else if (!filter.empty()) {
+                faiss::IDSelectorBitmap selected(ctx.bitmap.size(), ctx.bitmap.data());
+                search_selected(index, selected, query_embedding.data(), shortlist_k, ctx.distances.data(), ctx.labels.data());
+            } else if (meta->deleted_count() == 0) {
+                index->search(1, query_embedding.data(), shortlist_k, ctx.distances.data(), ctx.labels.data());
+            } else {
+                LiveRowSelector live(meta.get());
+                search_selected(index, live, query_embedding.data(), shortlist_k, ctx.distances.data(), ctx.labels.data());
+            }
+            if (quantized()) rerank(ctx, query_embedding.data(), candidate_k);
 
-            SearchResult final_res = res_meta;
-            final_res.score = final_score;
-            results.push_back(final_res);
+            int rank = 0;
+            for (faiss::idx_t row : ctx.labels) {
+                // Rows the backfill could not recover have no text; leave them out.
+                if (row < 0 || (size_t)row >= meta->size() || !meta->has_text(row)) continue;
+                RankFusion::Entry& e = fusion.add(meta->key(row), kVectorList, rank++, options.vector_weight);
+                if (e.row < 0) e.row = row;
+            }
         }
 
-        std::sort(results.begin(), results.end(), [](const SearchResult& a, const SearchResult& b) {
-            return a.score > b.score;
-        });
-        
-        if ((int)results.size() > top_k) {
-            results.resize(top_k);
+        // 3. Source weights and temporal decay over every candidate, then top-k
+        auto& entries = fusion.entries();
+        size_t n = entries.size();
+        ctx.stamps.resize(n);
+        ctx.rates.resize(n);
+        ctx.factors.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const RankFusion::Entry& e = entries[i];
+            const std::string& source = e.keyword >= 0 ? keyword_hits[e.keyword].source : meta->source(e.row);
+            const SourcePolicy& policy = source_policy(source);
+            ctx.stamps[i] = e.keyword >= 0 ? keyword_hits[e.keyword].timestamp : meta->timestamp(e.row);
+            ctx.rates[i] = policy.decay_rate;
+            ctx.factors[i] = policy.weight;
+        }
+        apply_temporal_decay(ctx.stamps, ctx.rates, ctx.factors);
+        for (size_t i = 0; i < n; ++i) entries[i].score *= ctx.factors[i];
+        fusion.select_top(top_k);
+
+        std::vector<SearchResult> results;
+        results.reserve(entries.size());
+#ifdef USE_SQLITE
+        std::vector<std::pair<size_t, int64_t>> texts; // result, documents rowid
+#endif
+        for (const auto& e : entries) {
+            results.push_back(e.keyword >= 0 ? keyword_hits[e.keyword] : meta->result(e.row));
+            results.back().score = e.score;
+#ifdef USE_SQLITE
+            if (e.keyword < 0 && meta->text_rowid(e.row) >= 0) texts.emplace_back(results.size() - 1, meta->text_rowid(e.row));
+#endif
         }
+#ifdef USE_SQLITE
+        // Only the final top_k vector hits read their text from SQLite.
+        index_lock.unlock();
+        fetch_texts(ctx, texts, results);
+#endif
         return results;
     }
 
 private:
-    void fetch_metadata_from_backend(const std::string& id, std::map<std::string, SearchResult>& metadata) {
 #ifdef USE_SQLITE
-        if (!db) return;
-        const char* sql = "SELECT path, start_line, end_line, text, source FROM docs WHERE id = ? LIMIT 1;";
-        sqlite3_stmt* stmt;
-        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_TRANSIENT);
-            if (sqlite3_step(stmt) == SQLITE_ROW) {
-                metadata[id] = {
-                    id,
-                    (const char*)sqlite3_column_text(stmt, 0),
-                    sqlite3_column_int(stmt, 1),
-                    sqlite3_column_int(stmt, 2),
-                    (const char*)sqlite3_column_text(stmt, 3),
-                    0.0f,
-                    (const char*)sqlite3_column_text(stmt, 4)
-                };
-            }
+    // ── SQLite connection setup ──────────────────────────────────────────────
+
+    void open_sqlite_schema() {
+        sqlite3_busy_timeout(db, 5000);
+        // WAL lets the reader connections run alongside the writer; with it,
+        // NORMAL only syncs on checkpoint and cannot corrupt the database.
+        sqlite3_exec(db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", nullptr, nullptr, nullptr);
+
+        const char* sql =
+            "CREATE TABLE IF NOT EXISTS documents("
+            "  rowid INTEGER PRIMARY KEY, id TEXT NOT NULL, path TEXT, text TEXT,"
+            "  start_line INTEGER, end_line INTEGER, source TEXT, timestamp INTEGER NOT NULL DEFAULT 0);"
+            "CREATE INDEX IF NOT EXISTS documents_id ON documents(id);"
+            "CREATE INDEX IF NOT EXISTS documents_path ON documents(path);"
+            "CREATE VIRTUAL TABLE IF NOT EXISTS documents_fts USING fts5(text, content='documents', content_rowid='rowid');"
+            "CREATE TRIGGER IF NOT EXISTS documents_ai AFTER INSERT ON documents BEGIN"
+            "  INSERT INTO documents_fts(rowid, text) VALUES (new.rowid, new.text);"
+            " END;"
+            "CREATE TRIGGER IF NOT EXISTS documents_ad AFTER DELETE ON documents BEGIN"
+            "  INSERT INTO documents_fts(documents_fts, rowid, text) VALUES ('delete', old.rowid, old.text);"
+            " END;"
+            "CREATE TRIGGER IF NOT EXISTS documents_au AFTER UPDATE ON documents BEGIN"
+            "  INSERT INTO documents_fts(documents_fts, rowid, text) VALUES ('delete', old.rowid, old.text);"
+            "  INSERT INTO documents_fts(rowid, text) VALUES (new.rowid, new.text);"
+            " END;";
+        char* err_msg = nullptr;
+        if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+            spdlog::error("Failed to create FTS5 tables: {}", err_msg);
+            sqlite3_free(err_msg);
+            return;
+        }
+
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v2(db, "SELECT timestamp FROM documents LIMIT 0;", -1, &stmt, nullptr) != SQLITE_OK) {
+            sqlite3_exec(db, "ALTER TABLE documents ADD COLUMN timestamp INTEGER NOT NULL DEFAULT 0;", nullptr, nullptr, nullptr);
+        }
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+
+        // Older indexes kept every column inside a single FTS5 table.
+        bool legacy = false;
+        if (sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE name = 'docs';", -1, &stmt, nullptr) == SQLITE_OK) {
+            legacy = sqlite3_step(stmt) == SQLITE_ROW;
             sqlite3_finalize(stmt);
         }
-#else
-        try {
-            IndexReaderPtr reader = IndexReader::open(directory);
-            if (reader) {
-                IndexSearcherPtr searcher = newLucene<IndexSearcher>(reader);
-                TermPtr term = newLucene<Term>(StringUtils::toUnicode("id"), StringUtils::toUnicode(id));
-                QueryPtr query = newLucene<TermQuery>(term);
-                TopDocsPtr top_docs = searcher->search(query, 1);
-                
-                if (top_docs->totalHits > 0) {
-                    DocumentPtr doc = searcher->doc(top_docs->scoreDocs[0]->doc);
-                    metadata[id] = {
-                        id,
-                        StringUtils::toUTF8(doc->get(StringUtils::toUnicode("path"))),
-                        std::stoi(StringUtils::toUTF8(doc->get(StringUtils::toUnicode("start_line")))),
-                        std::stoi(StringUtils::toUTF8(doc->get(StringUtils::toUnicode("end_line")))),
-                        StringUtils::toUTF8(doc->get(StringUtils::toUnicode("text"))),
-                        0.0f,
-                        StringUtils::toUTF8(doc->get(StringUtils::toUnicode("source")))
-                    };
-                }
-                reader->close();
+        if (legacy) {
+            const char* migrate =
+                "BEGIN;"
+                "INSERT INTO documents(id, path, text, start_line, end_line, source)"
+                "  SELECT id, path, text, CAST(start_line AS INTEGER), CAST(end_line AS INTEGER), source FROM docs;"
+                "DROP TABLE docs;"
+                "COMMIT;";
+            if (sqlite3_exec(db, migrate, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+                spdlog::error("Failed to migrate FTS5 table: {}", err_msg);
+                sqlite3_free(err_msg);
+                sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+            } else {
+                spdlog::info("Migrated keyword index to external-content FTS5");
             }
-        } catch (...) {
-            // Silently fail if metadata can't be fetched
         }
-#endif
     }
 
-    float apply_temporal_decay(const std::string& path, double lambda) {
-        // Look for YYYY-MM-DD in path
-        std::regex date_regex("(\\d{4})-(\\d{2})-(\\d{2})");
-        std::smatch match;
-        if (std::regex_search(path, match, date_regex)) {
-            try {
-                std::tm tm = {};
-                tm.tm_year = std::stoi(match[1]) - 1900;
-                tm.tm_mon = std::stoi(match[2]) - 1;
-                tm.tm_mday = std::stoi(match[3]);
-                
-                auto file_time = std::chrono::system_clock::from_time_t(std::mktime(&tm));
-                auto now = std::chrono::system_clock::now();
-                
-                auto age = std::chrono::duration_cast<std::chrono::hours>(now - file_time).count() / 24.0;
-                if (age < 0) age = 0;
-                
-                return (float)std::exp(-lambda * age);
-            } catch (...) {
-                return 1.0f;
-            }
+    // Statements are prepared once per connection and reset after each use.
+    static sqlite3_stmt* cached_stmt(sqlite3* conn, sqlite3_stmt*& slot, const char* sql) {
+        if (!slot && sqlite3_prepare_v2(conn, sql, -1, &slot, nullptr) != SQLITE_OK) {
+            spdlog::warn("SQLite prepare failed: {}", sqlite3_errmsg(conn));
+            sqlite3_finalize(slot);
+            slot = nullptr;
         }
-        return 1.0f; // No decay for non-dated files (MEMORY.md)
+        return slot;
     }
-};
-
-MemoryIndex::MemoryIndex(const std::string& index_path, int dimension)
-    : impl_(std::make_unique<Impl>(index_path, dimension)) {}
 
-MemoryIndex::MemoryIndex(const fs::path& index_path, int dimension)
-    : impl_(std::make_unique<Impl>(index_path.string(), dimension)) {}
+    // Filtered MATCH; the filter goes in the WHERE clause so LIMIT counts
+    // only matching rows. Returns the statement bound and ready to step.
+    static sqlite3_stmt* filtered_match_stmt(ReadContext& ctx, const std::string& query, const SearchFilter& filter, int limit) {
+        std::string sql =
+            "SELECT d.id, d.path, d.text, d.start_line, d.end_line, d.source, d.timestamp"
+            " FROM documents_fts JOIN documents d ON d.rowid = documents_fts.rowid"
+            " WHERE documents_fts MATCH ?";
+        if (!filter.sources.empty()) {
+            sql += " AND d.source IN (?";
+            for (size_t i = 1; i < filter.sources.size(); ++i) sql += ", ?";
+            sql += ")";
+        }
+        if (!filter.session.empty()) sql += " AND d.path = ?";
+        if (!filter.path_prefix.empty()) sql += " AND instr(d.path, ?) = 1";
+        if (filter.since || filter.until) sql += " AND d.timestamp > 0";
+        if (filter.since) sql += " AND d.timestamp >= ?";
+        if (filter.until) sql += " AND d.timestamp <= ?";
+        sql += " ORDER BY documents_fts.rank LIMIT ?;";
 
-MemoryIndex::~MemoryIndex() = default;
+        sqlite3_stmt* stmt = cached_stmt(ctx.db, ctx.filter_stmts[sql], sql.c_str());
+        if (!stmt) return nullptr;
+        int i = 1;
+        sqlite3_bind_text(stmt, i++, query.c_str(), -1, SQLITE_STATIC);
+        for (const auto& source : filter.sources) sqlite3_bind_text(stmt, i++, source.c_str(), -1, SQLITE_STATIC);
+        if (!filter.session.empty()) sqlite3_bind_text(stmt, i++, ("session:" + filter.session).c_str(), -1, SQLITE_TRANSIENT);
+        if (!filter.path_prefix.empty()) sqlite3_bind_text(stmt, i++, filter.path_prefix.c_str(), -1, SQLITE_STATIC);
+        if (filter.since) sqlite3_bind_int64(stmt, i++, filter.since);
+        if (filter.until) sqlite3_bind_int64(stmt, i++, filter.until);
+        sqlite3_bind_int(stmt, i, limit);
+        return stmt;
+    }
 
-void MemoryIndex::add_document(
-    const std::string& id,
-    const std::string& path,
-    int start_line,
-    int end_line,
-    const std::string& text,
-    const std::vector<float>& embedding,
-    const std::string& source
-) {
-    Impl::Request req;
-    req.type = Impl::Request::ADD;
-    req.id = id;
-    req.path = path;
-    req.start_line = start_line;
-    req.end_line = end_line;
-    req.text = text;
-    req.embedding = embedding;
-    req.source = source;
-    
-    auto calling_fiber = fiber_ident();
-    auto calling_node = FiberNode::current();
+    // Fill in the text of each (result, documents rowid) pair.
+    static void fetch_texts(ReadContext& ctx, const std::vector<std::pair<size_t, int64_t>>& texts,
+                            std::vector<SearchResult>& results) {
+        if (texts.empty() || !ctx.db) return;
+        const char* sql = "SELECT text FROM documents WHERE rowid = ?;";
+        sqlite3_stmt* stmt = cached_stmt(ctx.db, ctx.text_stmt, sql);
+        if (!stmt) return;
+        for (const auto& [i, rowid] : texts) {
+            sqlite3_bind_int64(stmt, 1, rowid);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                const char* text = (const char*)sqlite3_column_text(stmt, 0);
+                results[i].text = text ? text : "";
+            }
+            sqlite3_reset(stmt);
+        }
+    }
 
-    if (calling_node) {
-        req.on_complete = [calling_node, calling_fiber]() {
-            calling_node->spawn([calling_fiber]() {
-                fiber_resume(calling_fiber);
-            });
+    static void finalize_read_stmts(ReadContext& ctx) {
+        sqlite3_finalize(ctx.match_stmt);
+        sqlite3_finalize(ctx.by_id_stmt);
+        sqlite3_finalize(ctx.text_stmt);
+        ctx.match_stmt = nullptr;
+        ctx.by_id_stmt = nullptr;
+        ctx.text_stmt = nullptr;
+        for (auto& [sql, stmt] : ctx.filter_stmts) sqlite3_finalize(stmt);
+        ctx.filter_stmts.clear();
+    }
+#else
+    // ── Lucene writer / NRT searcher ─────────────────────────────────────────
+
+    // Holds a reference on the searcher's reader so a refresh on another
+    // thread can retire it without closing it under an in-flight search.
+    struct PinnedSearcher {
+        IndexSearcherPtr searcher;
+        explicit PinnedSearcher(IndexSearcherPtr s) : searcher(std::move(s)) {}
+        PinnedSearcher(const PinnedSearcher&) = delete;
+        PinnedSearcher& operator=(const PinnedSearcher&) = delete;
+        ~PinnedSearcher() {
+            try {
+                if (searcher) searcher->getIndexReader()->decRef();
+            } catch (...) {}
+        }
+    };
+
+    PinnedSearcher acquire_searcher() {
+        std::lock_guard<std::mutex> lock(searcher_mutex);
+        if (!writer) return PinnedSearcher(nullptr);
+        if (!searcher || searcher_generation != lucene_generation) {
+            // getReader() flushes buffered docs and reuses the segment readers
+            // the writer already holds, so only new segments are opened.
+            IndexReaderPtr fresh = writer->getReader();
+            if (reader) reader->decRef(); // closes once the last pin is released
+            reader = fresh;
+            searcher = newLucene<IndexSearcher>(reader);
+            searcher_generation = lucene_generation;
+        }
+        reader->incRef();
+        return PinnedSearcher(searcher);
+    }
+
+    static QueryPtr filtered_query(const QueryPtr& text, const SearchFilter& filter) {
+        BooleanQueryPtr query = newLucene<BooleanQuery>();
+        query->add(text, BooleanClause::MUST);
+        if (!filter.sources.empty()) {
+            BooleanQueryPtr any = newLucene<BooleanQuery>();
+            for (const auto& source : filter.sources) {
+                any->add(newLucene<TermQuery>(newLucene<Term>(StringUtils::toUnicode("source"), StringUtils::toUnicode(source))), BooleanClause::SHOULD);
+            }
+            query->add(any, BooleanClause::MUST);
+        }
+        if (!filter.session.empty()) {
+            TermPtr path = newLucene<Term>(StringUtils::toUnicode("path"), StringUtils::toUnicode("session:" + filter.session));
+            query->add(newLucene<TermQuery>(path), BooleanClause::MUST);
+        }
+        if (!filter.path_prefix.empty()) {
+            TermPtr prefix = newLucene<Term>(StringUtils::toUnicode("path"), StringUtils::toUnicode(filter.path_prefix));
+            query->add(newLucene<PrefixQuery>(prefix), BooleanClause::MUST);
+        }
+        return query;
+    }
+
+    static SearchResult lucene_result(const std::string& id, const DocumentPtr& doc) {
+        std::string path = StringUtils::toUTF8(doc->get(StringUtils::toUnicode("path")));
+        std::string stamp = StringUtils::toUTF8(doc->get(StringUtils::toUnicode("timestamp")));
+        // Documents indexed before timestamps were stored fall back to the path date.
+        int64_t timestamp = stamp.empty() ? date_from_path(path) : std::stoll(stamp);
+        return {
+            id,
+            path,
+            std::stoi(StringUtils::toUTF8(doc->get(StringUtils::toUnicode("start_line")))),
+            std::stoi(StringUtils::toUTF8(doc->get(StringUtils::toUnicode("end_line")))),
+            StringUtils::toUTF8(doc->get(StringUtils::toUnicode("text"))),
+            0.0f,
+            StringUtils::toUTF8(doc->get(StringUtils::toUnicode("source"))),
+            timestamp
         };
-        {
-            std::lock_guard<std::mutex> lock(impl_->queue_mutex);
-            impl_->queue.push(std::move(req));
+    }
+
+    void maybe_commit_keyword(bool force) {
+        if (!writer || !lucene_dirty) return;
+        auto now = std::chrono::steady_clock::now();
+        if (!force && now - last_commit < std::chrono::milliseconds(options.keyword_commit_interval_ms)) return;
+        try {
+            writer->commit();
+            lucene_dirty = false;
+            last_commit = now;
+        } catch (const std::exception& e) {
+            spdlog::warn("Lucene commit failed: {}", e.what());
         }
-        impl_->queue_cv.notify_one();
-        fiber_suspend(0);
-    } else {
-        std::condition_variable cv;
-        std::mutex mtx;
-        bool done = false;
-        req.on_complete = [&cv, &mtx, &done]() {
+    }
+#endif
+
+    // ── Vector storage ───────────────────────────────────────────────────────
+
+    bool quantized() const {
+        return options.vector_storage == "fp16" || options.vector_storage == "sq8";
+    }
+
+    // `rows` backs the index under fp32 storage; quantized indexes hold codes.
+    std::unique_ptr<faiss::Index> new_flat_index(VectorFile* rows) const {
+        if (options.vector_storage == "fp16") {
+            return std::make_unique<faiss::IndexScalarQuantizer>(dimension, faiss::ScalarQuantizer::QT_fp16, faiss::METRIC_INNER_PRODUCT);
+        }
+        if (options.vector_storage == "sq8") {
+            auto sq = std::make_unique<faiss::IndexScalarQuantizer>(dimension, faiss::ScalarQuantizer::QT_8bit, faiss::METRIC_INNER_PRODUCT);
+            // Embeddings are unit length, so every component lies in [-1, 1].
+            // A fixed range keeps codes comparable across restarts and
+            // compactions without holding back rows for training.
+            std::vector<float> range(2 * (size_t)dimension, 1.0f);
+            std::fill(range.begin(), range.begin() + dimension, -1.0f);
+            sq->train(2, range.data());
+            return sq;
+        }
+        return std::make_unique<MappedFlatIndex>(rows);
+    }
+
+    bool storage_matches(faiss::Index* idx) const {
+        auto* sq = dynamic_cast<faiss::IndexScalarQuantizer*>(idx);
+        if (options.vector_storage == "fp16") return sq && sq->sq.qtype == faiss::ScalarQuantizer::QT_fp16;
+        if (options.vector_storage == "sq8") return sq && sq->sq.qtype == faiss::ScalarQuantizer::QT_8bit;
+        return dynamic_cast<MappedFlatIndex*>(idx) != nullptr;
+    }
+
+    // A quantized checkpoint in another encoding: re-encode it, preferring
+    // the full-precision rows.
+    void convert_storage() {
+        faiss::idx_t n = faiss_index->ntotal;
+        std::vector<float> rows((size_t)n * dimension);
+        bool exact = n > 0 && fp32_vectors->row(n - 1);
+        if (exact) {
+            std::memcpy(rows.data(), fp32_vectors->row(0), rows.size() * sizeof(float));
+        } else {
+            faiss_index->reconstruct_n(0, n, rows.data());
+        }
+        faiss_index = new_flat_index(fp32_vectors.get());
+        faiss_index->add(n, rows.data());
+        if (!exact) {
+            fp32_vectors->reset();
+            fp32_vectors->append(rows.data(), n);
+            fp32_vectors->flush();
+        }
+        fs::path faiss_path = fs::path(index_path) / "faiss.index";
+        faiss::write_index(faiss_index.get(), faiss_path.string().c_str());
+        spdlog::info("Re-encoded {} vectors as {}", n, options.vector_storage);
+    }
+
+    // fp32 storage keeps no faiss.index. One written by an older version or
+    // by quantized storage supplies the rows vectors.f32 lacks, then goes.
+    void adopt_checkpoint(faiss::Index* loaded) {
+        size_t have = fp32_vectors->size();
+        if (have < (size_t)loaded->ntotal) {
+            faiss::idx_t n = loaded->ntotal - (faiss::idx_t)have;
+            std::vector<float> rows((size_t)n * dimension);
+            loaded->reconstruct_n((faiss::idx_t)have, n, rows.data());
+            fp32_vectors->append(rows.data(), n);
+            fp32_vectors->flush();
+            spdlog::info("Moved {} vectors from faiss.index to vectors.f32", n);
+        }
+        std::error_code ec;
+        fs::remove(fs::path(index_path) / "faiss.index", ec);
+    }
+
+    // Quantized storage: rows vectors.f32 holds past the checkpoint (all of
+    // them when switching from fp32) are encoded rather than replayed.
+    void encode_vectors() {
+        size_t have = fp32_vectors->readable();
+        if (have <= (size_t)faiss_index->ntotal) return;
+        faiss::idx_t from = faiss_index->ntotal;
+        faiss::idx_t n = (faiss::idx_t)have - from;
+        faiss_index->add(n, fp32_vectors->row(from));
+        if (from == 0) {
+            faiss::write_index(faiss_index.get(), (fs::path(index_path) / "faiss.index").string().c_str());
+            spdlog::info("Encoded {} vectors as {}", n, options.vector_storage);
+        }
+    }
+
+    // After WAL replay: fill any rows the side file lost from the quantized codes.
+    void sync_vectors() {
+        size_t have = fp32_vectors->size();
+        if (have < (size_t)faiss_index->ntotal) {
+            faiss::idx_t n = faiss_index->ntotal - (faiss::idx_t)have;
+            std::vector<float> rows((size_t)n * dimension);
+            faiss_index->reconstruct_n((faiss::idx_t)have, n, rows.data());
+            fp32_vectors->append(rows.data(), n);
+            spdlog::warn("Recovered {} full-precision vectors from quantized codes", n);
+        }
+        fp32_vectors->flush();
+    }
+
+    // Rows [from, from + n) at full precision, for building other indexes.
+    void read_vectors(faiss::idx_t from, faiss::idx_t n, float* out) const {
+        if (n > 0 && fp32_vectors->row(from + n - 1)) {
+            std::memcpy(out, fp32_vectors->row(from), (size_t)n * dimension * sizeof(float));
+        } else {
+            faiss_index->reconstruct_n(from, n, out);
+        }
+    }
+
+    // ── Vector persistence (WAL + checkpoints) ───────────────────────────────
+
+    std::vector<std::pair<uint64_t, fs::path>> sealed_wals() const {
+        std::vector<std::pair<uint64_t, fs::path>> out;
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(index_path, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("faiss.wal.", 0) != 0) continue;
+            try {
+                out.emplace_back(std::stoull(name.substr(10)), entry.path());
+            } catch (...) {}
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    void replay_wal() {
+        auto apply = [this](uint64_t row, const std::string& id, const std::vector<float>& embedding) {
+            if ((int)embedding.size() != dimension) return;
+            if (row >= (uint64_t)faiss_index->ntotal) {
+                row = (uint64_t)faiss_index->ntotal;
+                faiss_index->add(1, embedding.data());
+                if (quantized() && fp32_vectors->size() == row) fp32_vectors->append(embedding.data());
+            }
+            // The vector made it to disk but its metadata may not have.
+            if (row >= meta->size()) recovered_ids[(faiss::idx_t)row] = id;
+        };
+
+        faiss::idx_t before = faiss_index->ntotal;
+        for (const auto& [seq, sealed] : sealed_wals()) {
+            VectorWal::replay(sealed, apply);
+            wal_seq = std::max(wal_seq, seq);
+        }
+        fs::path wal_path = fs::path(index_path) / "faiss.wal";
+        VectorWal::replay(wal_path, apply);
+        if (faiss_index->ntotal > before) {
+            spdlog::info("Replayed {} vectors from WAL", faiss_index->ntotal - before);
+        }
+
+        wal = std::make_unique<VectorWal>(wal_path);
+        wal->open();
+    }
+
+    // Checkpoint once the WAL (or, under fp32, the unsynced tail of
+    // vectors.f32) is large, or periodically if it holds anything.
+    void maybe_checkpoint() {
+        uint64_t pending = quantized() ? wal->bytes() : unsynced_bytes + wal->bytes();
+        if (checkpointing || pending == 0) return;
+        bool too_big = pending >= options.wal_checkpoint_bytes;
+        bool too_old = std::chrono::steady_clock::now() - last_checkpoint >= std::chrono::seconds(options.wal_checkpoint_interval_sec);
+        if (too_big || too_old) checkpoint();
+    }
+
+    void checkpoint() {
+        if (checkpoint_thread.joinable()) checkpoint_thread.join();
+        last_checkpoint = std::chrono::steady_clock::now();
+
+        // Snapshot on the worker so the background write sees a consistent
+        // index, then seal the log those rows came from. Under fp32 the rows
+        // are already in vectors.f32, flushed to the OS with each batch; the
+        // log only holds what an older version or quantized storage left.
+        std::shared_ptr<faiss::Index> snapshot;
+        if (quantized()) snapshot.reset(faiss::clone_index(faiss_index.get()));
+        uint64_t seq = ++wal_seq;
+        if (wal->bytes() > 0) wal->rotate_to(fs::path(index_path) / ("faiss.wal." + std::to_string(seq)));
+        unsynced_bytes = 0;
+        checkpointing = true;
+
+        checkpoint_thread = std::thread([this, snapshot, seq]() {
+            try {
+                fs::path dir(index_path);
+                if (snapshot) {
+                    faiss::write_index(snapshot.get(), (dir / "faiss.index.tmp").string().c_str());
+                    fs::rename(dir / "faiss.index.tmp", dir / "faiss.index");
+                } else {
+                    // A row's vector lands before its metadata, so a crash
+                    // between the two leaves only a vector, which
+                    // backfill_meta tombstones.
+                    sync_file(dir / "vectors.f32");
+                    for (const auto& file : MetaStore::files(dir, "meta")) sync_file(file);
+                }
+
+                for (const auto& [s, sealed] : sealed_wals()) {
+                    if (s <= seq) fs::remove(sealed);
+                }
+                if (snapshot) spdlog::debug("Checkpointed Faiss index with {} vectors", snapshot->ntotal);
+            } catch (const std::exception& e) {
+                spdlog::warn("Faiss checkpoint failed: {}", e.what());
+            } catch (...) {
+                spdlog::warn("Faiss checkpoint failed");
+            }
+            checkpointing = false;
+        });
+    }
+
+    // ── Approximate index lifecycle ──────────────────────────────────────────
+
+    bool ann_enabled() const {
+        return options.index_type == "hnsw" || options.index_type == "ivfpq";
+    }
+
+    faiss::Index* new_ann_index(faiss::idx_t n) const {
+        if (options.index_type == "hnsw") {
+            auto* hnsw = new faiss::IndexHNSWFlat(dimension, options.hnsw_m, faiss::METRIC_INNER_PRODUCT);
+            hnsw->hnsw.efConstruction = options.hnsw_ef_construction;
+            hnsw->hnsw.efSearch = options.hnsw_ef_search;
+            return hnsw;
+        }
+
+        // IVF needs ~39 training points per centroid; shrink nlist for small corpora.
+        size_t nlist = std::max<size_t>(1, std::min<size_t>(options.ivf_nlist, n / 39));
+        int m = std::max(1, std::min(options.pq_m, dimension));
+        while (dimension % m != 0) --m;
+        auto* quantizer = new faiss::IndexFlatIP(dimension);
+        auto* ivfpq = new faiss::IndexIVFPQ(quantizer, dimension, nlist, m, options.pq_nbits, faiss::METRIC_INNER_PRODUCT);
+        ivfpq->own_fields = true;
+        ivfpq->nprobe = std::min<size_t>(options.ivf_nprobe, nlist);
+        return ivfpq;
+    }
+
+    bool ann_matches_type(faiss::Index* idx) const {
+        if (options.index_type == "hnsw") return dynamic_cast<faiss::IndexHNSWFlat*>(idx) != nullptr;
+        if (options.index_type == "ivfpq") return dynamic_cast<faiss::IndexIVFPQ*>(idx) != nullptr;
+        return false;
+    }
+
+    void load_ann_index() {
+        fs::path ann_path = fs::path(index_path) / "faiss_ann.index";
+        if (!ann_enabled() || !fs::exists(ann_path)) return;
+        try {
+            std::unique_ptr<faiss::Index> idx(faiss::read_index(ann_path.string().c_str()));
+            if (!ann_matches_type(idx.get()) || idx->d != dimension || idx->ntotal > faiss_index->ntotal) {
+                spdlog::info("Discarding stale ANN index at {}", ann_path.string());
+                return;
+            }
+            if (auto* hnsw = dynamic_cast<faiss::IndexHNSWFlat*>(idx.get())) {
+                hnsw->hnsw.efSearch = options.hnsw_ef_search;
+            } else if (auto* ivf = dynamic_cast<faiss::IndexIVFPQ*>(idx.get())) {
+                ivf->nprobe = std::min<size_t>(options.ivf_nprobe, ivf->nlist);
+            }
+            ann_trained_rows = idx->ntotal;
+            catch_up_ann(idx.get(), idx->ntotal);
+            ann_index = std::move(idx);
+            spdlog::info("Loaded {} ANN index with {} vectors", options.index_type, ann_index->ntotal);
+        } catch (...) {
+            spdlog::warn("Failed to load ANN index from {}", ann_path.string());
+        }
+    }
+
+    // Add rows [from, ntotal) of the flat index that the ANN index has not seen yet.
+    void catch_up_ann(faiss::Index* ann, faiss::idx_t from) {
+        faiss::idx_t n = faiss_index->ntotal - from;
+        if (n <= 0) return;
+        std::vector<float> tail((size_t)n * dimension);
+        read_vectors(from, n, tail.data());
+        ann->add(n, tail.data());
+    }
+
+    // HNSW grows incrementally, so it is built once. IVF-PQ centroids drift as
+    // the corpus grows, so it is retrained whenever the corpus has doubled.
+    void maybe_rebuild_ann() {
+        if (!ann_enabled() || ann_building) return;
+        faiss::idx_t n = faiss_index->ntotal;
+        // PQ codebooks need at least 2^nbits training points.
+        if (n < options.ann_min_vectors || n < (1 << options.pq_nbits)) return;
+        if (ann_index && (options.index_type == "hnsw" || n < 2 * ann_trained_rows)) return;
+
+        auto snapshot = std::make_shared<std::vector<float>>((size_t)n * dimension);
+        read_vectors(0, n, snapshot->data());
+
+        if (ann_thread.joinable()) ann_thread.join();
+        ann_building = true;
+        uint64_t epoch = ann_epoch;
+        spdlog::info("Building {} index over {} vectors in background", options.index_type, n);
+        ann_thread = std::thread([this, snapshot, n, epoch]() {
+            Request req;
+            req.type = Request::ANN_READY;
+            req.built_rows = n;
+            req.built_epoch = epoch;
+            try {
+                std::shared_ptr<faiss::Index> idx(new_ann_index(n));
+                if (!idx->is_trained) {
+                    faiss::idx_t train_n = std::min<faiss::idx_t>(n, 256 * (faiss::idx_t)options.ivf_nlist);
+                    idx->train(train_n, snapshot->data());
+                }
+                idx->add(n, snapshot->data());
+                req.built_ann = std::move(idx);
+            } catch (const std::exception& e) {
+                spdlog::error("ANN index build failed: {}", e.what());
+            }
             {
-                std::lock_guard<std::mutex> lock(mtx);
-                done = true;
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                queue.push(std::move(req));
             }
-            cv.notify_one();
+            queue_cv.notify_one();
+        });
+    }
+
+    void install_ann(Request& req) {
+        ann_building = false;
+        if (!req.built_ann || req.built_epoch != ann_epoch) return;
+
+        // The worker kept adding while the build ran; replay those rows so the
+        // swap is invisible to searches.
+        catch_up_ann(req.built_ann.get(), req.built_rows);
+        {
+            std::unique_lock<std::shared_mutex> lock(index_mutex);
+            ann_index = std::move(req.built_ann);
+        }
+        ann_trained_rows = req.built_rows;
+        spdlog::info("{} index ready with {} vectors", options.index_type, ann_index->ntotal);
+
+        try {
+            fs::path ann_path = fs::path(index_path) / "faiss_ann.index";
+            faiss::write_index(ann_index.get(), ann_path.string().c_str());
+        } catch (...) {
+            spdlog::warn("Failed to persist ANN index");
+        }
+    }
+
+    // Search only the rows `sel` accepts, inside Faiss, so the index still
+    // returns k matching candidates. HNSW and IVF only accept their own
+    // parameter types, which also carry the search-time knobs.
+    static void search_selected(faiss::Index* index, faiss::IDSelector& sel, const float* query, faiss::idx_t k, float* distances, faiss::idx_t* labels) {
+        if (auto* hnsw = dynamic_cast<faiss::IndexHNSWFlat*>(index)) {
+            faiss::SearchParametersHNSW params;
+            params.sel = &sel;
+            params.efSearch = hnsw->hnsw.efSearch;
+            index->search(1, query, k, distances, labels, &params);
+        } else if (auto* ivf = dynamic_cast<faiss::IndexIVFPQ*>(index)) {
+            faiss::SearchParametersIVF params;
+            params.sel = &sel;
+            params.nprobe = ivf->nprobe;
+            index->search(1, query, k, distances, labels, &params);
+        } else {
+            faiss::SearchParameters params;
+            params.sel = &sel;
+            index->search(1, query, k, distances, labels, &params);
+        }
+    }
+
+    // Decay-aware exact scan over the shards. Every shard's bound (its best
+    // possible similarity |q| * max norm, times its source weight and the
+    // decay of its newest row) orders the visit, and the scan stops once the
+    // k-th best decayed score so far reaches the next bound. Shards are
+    // shared out with the helper threads. Candidates are picked by decayed
+    // score but returned in similarity order, so fusion ranks them as it
+    // ranks any other vector hits.
+    void search_shards(ReadContext& ctx, const float* query, int k, const uint8_t* bitmap) {
+        const auto& all = shards.shards();
+        auto scan = std::make_shared<ShardScan>();
+        scan->query = query;
+        scan->k = (size_t)k;
+        scan->bitmap = bitmap;
+        scan->now = (double)std::time(nullptr);
+        scan->bounds.resize(all.size());
+        scan->policies.resize(all.size());
+        scan->order.resize(all.size());
+        float qnorm = std::sqrt(faiss::fvec_norm_L2sqr(query, dimension));
+        for (size_t i = 0; i < all.size(); ++i) {
+            const SourcePolicy& policy = source_policy(meta->sources()[all[i].source]);
+            scan->policies[i] = {policy.weight, policy.decay_rate};
+            scan->bounds[i] = qnorm * all[i].max_norm * policy.weight * decay_factor(all[i].newest, policy.decay_rate, scan->now);
+            scan->order[i] = (uint32_t)i;
+        }
+        std::sort(scan->order.begin(), scan->order.end(), [&](uint32_t a, uint32_t b) { return scan->bounds[a] > scan->bounds[b]; });
+
+        size_t helpers = std::min(shard_threads.size(), all.size() - 1);
+        if (helpers > 0) {
+            std::lock_guard<std::mutex> lock(shard_mutex);
+            for (size_t i = 0; i < helpers; ++i) shard_tasks.push([this, scan]() { scan_shards(*scan); });
+        }
+        for (size_t i = 0; i < helpers; ++i) shard_cv.notify_one();
+        scan_shards(*scan);
+        {
+            // Helpers that claimed a shard still read the caller's query and bitmap.
+            std::unique_lock<std::mutex> lock(scan->mutex);
+            scan->cv.wait(lock, [&] { return scan->active == 0; });
+        }
+
+        auto& top = scan->top;
+        std::sort(top.begin(), top.end(), [](const ShardCandidate& a, const ShardCandidate& b) { return a.sim > b.sim; });
+        for (size_t i = 0; i < ctx.labels.size(); ++i) {
+            ctx.labels[i] = i < top.size() ? top[i].row : -1;
+            ctx.distances[i] = i < top.size() ? top[i].sim : 0.0f;
+        }
+    }
+
+    // Claim and scan shards until none is left that could enter the top k.
+    void scan_shards(ShardScan& scan) {
+        auto by_score = [](const ShardCandidate& a, const ShardCandidate& b) { return a.score > b.score; };
+        std::vector<ShardCandidate> local;
+        std::unique_lock<std::mutex> lock(scan.mutex);
+        ++scan.active;
+        while (scan.next < scan.order.size()) {
+            uint32_t shard = scan.order[scan.next];
+            bool full = scan.top.size() == scan.k;
+            if (full && scan.bounds[shard] <= scan.top.front().score) {
+                scan.next = scan.order.size(); // later shards are bounded lower still
+                break;
+            }
+            ++scan.next;
+            float floor = full ? scan.top.front().score : -std::numeric_limits<float>::infinity();
+            lock.unlock();
+
+            local.clear();
+            scan_shard(scan, shard, floor, local);
+
+            lock.lock();
+            for (const auto& c : local) {
+                if (scan.top.size() < scan.k) {
+                    scan.top.push_back(c);
+                    std::push_heap(scan.top.begin(), scan.top.end(), by_score);
+                } else if (c.score > scan.top.front().score) {
+                    std::pop_heap(scan.top.begin(), scan.top.end(), by_score);
+                    scan.top.back() = c;
+                    std::push_heap(scan.top.begin(), scan.top.end(), by_score);
+                }
+            }
+        }
+        if (--scan.active == 0) scan.cv.notify_all();
+    }
+
+    // The best k rows of one shard scoring above `floor`.
+    void scan_shard(const ShardScan& scan, uint32_t shard, float floor, std::vector<ShardCandidate>& out) const {
+        auto by_score = [](const ShardCandidate& a, const ShardCandidate& b) { return a.score > b.score; };
+        const auto& rows = shards.shards()[shard].rows;
+        auto [weight, rate] = scan.policies[shard];
+        for (int64_t row : rows) {
+            if (scan.bitmap ? !(scan.bitmap[row >> 3] & (1 << (row & 7))) : meta->deleted(row)) continue;
+            const float* v = fp32_vectors->row((size_t)row);
+            if (!v) continue;
+            float sim = faiss::fvec_inner_product(scan.query, v, dimension);
+            float score = sim * weight * decay_factor(meta->timestamp(row), rate, scan.now);
+            if (score <= floor) continue;
+            if (out.size() < scan.k) {
+                out.push_back({score, sim, (faiss::idx_t)row});
+                std::push_heap(out.begin(), out.end(), by_score);
+            } else if (score > out.front().score) {
+                std::pop_heap(out.begin(), out.end(), by_score);
+                out.back() = {score, sim, (faiss::idx_t)row};
+                std::push_heap(out.begin(), out.end(), by_score);
+            }
+        }
+    }
+
+    // Set ctx.bitmap for live rows passing the filter; returns how many do.
+    // Paths and sources are tested once per distinct value.
+    size_t filter_rows(ReadContext& ctx, const SearchFilter& filter) const {
+        const auto& paths = meta->paths();
+        const auto& sources = meta->sources();
+        ctx.path_ok.resize(paths.size());
+        ctx.source_ok.resize(sources.size());
+        for (size_t i = 0; i < paths.size(); ++i) ctx.path_ok[i] = filter.matches_path(paths[i]);
+        for (size_t i = 0; i < sources.size(); ++i) ctx.source_ok[i] = filter.matches_source(sources[i]);
+
+        size_t rows = meta->size();
+        size_t matched = 0;
+        ctx.bitmap.assign((rows + 7) / 8, 0);
+        for (size_t row = 0; row < rows; ++row) {
+            if (!ctx.source_ok[meta->source_index(row)] || !ctx.path_ok[meta->path_index(row)]) continue;
+            if (!filter.matches_time(meta->timestamp(row)) || meta->deleted(row)) continue;
+            ctx.bitmap[row >> 3] |= (uint8_t)(1u << (row & 7));
+            ++matched;
+        }
+        return matched;
+    }
+
+    // Re-score the shortlist in ctx.labels against the full-precision rows
+    // and keep the best k.
+    void rerank(ReadContext& ctx, const float* query, int k) const {
+        auto& rescored = ctx.rescored;
+        rescored.clear();
+        for (size_t i = 0; i < ctx.labels.size(); ++i) {
+            faiss::idx_t row = ctx.labels[i];
+            if (row < 0) continue;
+            const float* v = fp32_vectors->row(row);
+            rescored.emplace_back(v ? faiss::fvec_inner_product(query, v, dimension) : ctx.distances[i], row);
+        }
+        size_t n = std::min<size_t>(k, rescored.size());
+        std::partial_sort(rescored.begin(), rescored.begin() + n, rescored.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        ctx.distances.resize(n);
+        ctx.labels.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            ctx.distances[i] = rescored[i].first;
+            ctx.labels[i] = rescored[i].second;
+        }
+    }
+
+    // ── Tombstone compaction ─────────────────────────────────────────────────
+
+    void rebuild_live_rows() {
+        live_rows.clear();
+        live_rows.reserve(meta->size() - meta->deleted_count());
+        for (size_t row = 0; row < meta->size(); ++row) {
+            if (meta->deleted(row)) continue;
+            live_rows.emplace(meta->key(row), (faiss::idx_t)row);
+        }
+    }
+
+    // Worker only. Reads every vector once for its norm, so it runs outside
+    // the lock and is swapped in whole.
+    void rebuild_shards() {
+        if (quantized() || !decay_enabled) return;
+        ShardIndex built;
+        for (size_t row = 0; row < meta->size(); ++row) {
+            const float* v = fp32_vectors->row(row);
+            float norm = v ? std::sqrt(faiss::fvec_norm_L2sqr(v, dimension)) : 0.0f;
+            built.add((int64_t)row, meta->source_index(row), meta->timestamp(row), norm);
+        }
+        std::unique_lock<std::shared_mutex> lock(index_mutex);
+        shards = std::move(built);
+        shards_ready = true;
+    }
+
+    // (staged, live) file pairs swapped by a compaction.
+    std::vector<std::pair<fs::path, fs::path>> compaction_files() const {
+        fs::path dir(index_path);
+        std::vector<std::pair<fs::path, fs::path>> files = {
+            {dir / "faiss.index.compact", dir / "faiss.index"},
+            {dir / "faiss.wal.compact", dir / "faiss.wal"},
+            {dir / "vectors.f32.compact", dir / "vectors.f32"},
         };
+        auto staged = MetaStore::files(dir, "meta.compact");
+        auto live = MetaStore::files(dir, "meta");
+        for (size_t i = 0; i < staged.size(); ++i) files.emplace_back(staged[i], live[i]);
+        return files;
+    }
+
+    // The marker is written once every staged file is complete, so a swap
+    // interrupted by a crash is finished on startup rather than undone.
+    void finish_compaction() {
+        fs::path dir(index_path);
+        std::error_code ec;
+        for (const auto& [staged, live] : compaction_files()) {
+            if (fs::exists(staged, ec)) fs::rename(staged, live, ec);
+        }
+        // Sealed logs and the ANN index are numbered by the old rows.
+        for (const auto& [seq, sealed] : sealed_wals()) fs::remove(sealed, ec);
+        fs::remove(dir / "faiss_ann.index", ec);
+        fs::remove(dir / "COMPACTING", ec);
+    }
+
+    void discard_compaction() {
+        std::error_code ec;
+        for (const auto& [staged, live] : compaction_files()) fs::remove(staged, ec);
+    }
+
+    void recover_compaction() {
+        if (fs::exists(fs::path(index_path) / "COMPACTING")) {
+            finish_compaction();
+            spdlog::info("Finished interrupted index compaction");
+        } else {
+            discard_compaction();
+        }
+    }
+
+    void maybe_compact() {
+        if (compacting) return;
+        size_t dead = meta->deleted_count();
+        if (dead == 0 || dead < (size_t)options.compact_min_tombstones) return;
+        if ((double)dead < options.compact_tombstone_ratio * (double)meta->size()) return;
+
+        if (compact_thread.joinable()) compact_thread.join();
+        discard_compaction();
+        compacting = true;
+        faiss::idx_t rows = faiss_index->ntotal;
+        uint64_t epoch = compact_epoch;
+        spdlog::info("Compacting index: {} of {} rows are tombstones", dead, rows);
+        compact_thread = std::thread([this, rows, epoch]() {
+            Request req;
+            req.type = Request::COMPACT_READY;
+            req.built_rows = rows;
+            req.built_epoch = epoch;
+            try {
+                build_compaction(req);
+            } catch (const std::exception& e) {
+                spdlog::error("Index compaction failed: {}", e.what());
+                req.compacted.reset();
+            }
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                queue.push(std::move(req));
+            }
+            queue_cv.notify_one();
+        });
+    }
+
+    // Copy the live rows below req.built_rows into the staged files. Reads
+    // go through the shared lock in chunks, so searches and adds carry on.
+    void build_compaction(Request& req) {
+        fs::path dir(index_path);
+        auto store = std::make_unique<MetaStore>(dir, "meta.compact");
+        auto exact = std::make_unique<VectorFile>(dir / "vectors.f32.compact", dimension);
+        auto compacted = new_flat_index(exact.get());
+        req.compacted_rows.assign(req.built_rows, -1);
+
+        const faiss::idx_t chunk = 4096;
+        std::vector<float> vectors;
+        for (faiss::idx_t from = 0; from < req.built_rows; from += chunk) {
+            faiss::idx_t to = std::min(req.built_rows, from + chunk);
+            vectors.clear();
+            {
+                std::shared_lock<std::shared_mutex> lock(index_mutex);
+                if (compact_epoch != req.built_epoch) return;
+                for (faiss::idx_t row = from; row < to; ++row) {
+                    if (meta->deleted(row)) continue;
+                    req.compacted_rows[row] = (faiss::idx_t)store->size();
+                    vectors.resize(vectors.size() + dimension);
+                    read_vectors(row, 1, vectors.data() + vectors.size() - dimension);
+                    store->append(std::string(meta->id(row)), meta->path(row), meta->start_line(row), meta->end_line(row),
+                                  std::string(meta->text(row)), meta->source(row), meta->timestamp(row), meta->text_rowid(row));
+                }
+            }
+            compacted->add((faiss::idx_t)(vectors.size() / dimension), vectors.data());
+            if (quantized()) exact->append(vectors.data(), vectors.size() / dimension);
+        }
+
+        store->flush();
+        exact->flush();
+        if (quantized()) faiss::write_index(compacted.get(), (dir / "faiss.index.compact").string().c_str());
+        req.compacted = std::move(compacted);
+        req.compacted_meta = std::move(store);
+        req.compacted_vectors = std::move(exact);
+    }
+
+    void install_compaction(Request& req) {
+        compacting = false;
+        if (!req.compacted || req.built_epoch != compact_epoch) {
+            req.compacted_meta.reset();
+            req.compacted_vectors.reset();
+            discard_compaction();
+            return;
+        }
+        // A checkpoint still writing the old numbering must land before the swap.
+        if (checkpoint_thread.joinable()) checkpoint_thread.join();
+
+        fs::path dir(index_path);
+        MetaStore& store = *req.compacted_meta;
+        for (faiss::idx_t row = 0; row < req.built_rows; ++row) {
+            faiss::idx_t to = req.compacted_rows[row];
+            if (to >= 0 && meta->deleted(row)) store.remove(to); // removed during the build
+        }
+
+        // Rows added during the build are renumbered onto the end. Quantized
+        // codes stop at the snapshot, so those rows also go to a fresh WAL;
+        // under fp32 it stays empty, replacing any log of the old numbering.
+        fs::remove(dir / "faiss.wal.compact");
+        VectorWal tail(dir / "faiss.wal.compact");
+        tail.open();
+        std::vector<float> vec(dimension);
+        for (faiss::idx_t row = req.built_rows; row < faiss_index->ntotal; ++row) {
+            if (meta->deleted(row)) continue;
+            read_vectors(row, 1, vec.data());
+            if (quantized()) tail.append(req.compacted->ntotal, std::string(meta->id(row)), vec.data(), dimension);
+            req.compacted->add(1, vec.data());
+            if (quantized()) req.compacted_vectors->append(vec.data());
+            store.append(std::string(meta->id(row)), meta->path(row), meta->start_line(row), meta->end_line(row),
+                         std::string(meta->text(row)), meta->source(row), meta->timestamp(row), meta->text_rowid(row));
+        }
+        tail.close();
+        store.flush();
+        req.compacted_meta.reset(); // close the staged files before renaming them
+        req.compacted_vectors.reset();
+        if (!quantized()) req.compacted.reset(); // it mapped the staged file; rebuilt below
+        // The swap replaces the synced files, so the staged ones are synced first.
+        for (const auto& [staged, live] : compaction_files()) {
+            if (fs::exists(staged)) sync_file(staged);
+        }
+        unsynced_bytes = 0;
+
+        faiss::idx_t before = faiss_index->ntotal;
+        std::ofstream(dir / "COMPACTING").close();
         {
-            std::lock_guard<std::mutex> lock(impl_->queue_mutex);
-            impl_->queue.push(std::move(req));
+            std::unique_lock<std::shared_mutex> lock(index_mutex);
+            wal->close();
+            meta.reset();
+            fp32_vectors->close();
+            finish_compaction();
+            ann_index.reset();
+            meta = std::make_unique<MetaStore>(dir);
+            fp32_vectors = std::make_unique<VectorFile>(dir / "vectors.f32", dimension);
+            faiss_index = quantized() ? std::move(req.compacted) : new_flat_index(fp32_vectors.get());
+            wal = std::make_unique<VectorWal>(dir / "faiss.wal");
+            wal->open();
+            shards_ready = false; // row numbers changed
         }
-        impl_->queue_cv.notify_one();
-        std::unique_lock<std::mutex> lock(mtx);
-        cv.wait(lock, [&done] { return done; });
+        ann_trained_rows = 0;
+        ++ann_epoch;
+        rebuild_live_rows();
+        rebuild_shards();
+        spdlog::info("Compacted index from {} to {} rows", before, faiss_index->ntotal);
+        maybe_rebuild_ann();
     }
+
+    // ── Embedding changes ────────────────────────────────────────────────────
+
+    // embedding.id records the model and dimension the vectors were made
+    // with. Vectors from another model or dimension cannot answer this one's
+    // queries, so they and their metadata are dropped before anything loads
+    // them, and the documents (still in the keyword backend) are marked for
+    // reembed(). Indexes older than the file are checked by dimension only.
+    void check_embedding() {
+        fs::path dir(index_path);
+        fs::path stamp_path = dir / "embedding.id";
+        fs::path pending_path = dir / "reembed.pending";
+        std::string model;
+        int dim = 0;
+        {
+            std::ifstream in(stamp_path);
+            std::getline(in, model);
+            in >> dim;
+        }
+        bool stamped = dim != 0;
+        if (!stamped) dim = VectorFile::stored_dim(dir / "vectors.f32");
+
+        bool changed = (dim != 0 && dim != dimension) ||
+                       (!model.empty() && !options.embedding_model.empty() && model != options.embedding_model);
+        if (changed) {
+            spdlog::warn("Embeddings changed from {} ({} dims) to {} ({} dims); stored documents will be re-embedded",
+                         model.empty() ? "an unknown model" : model, dim,
+                         options.embedding_model.empty() ? "an unknown model" : options.embedding_model, dimension);
+            std::ofstream(pending_path).flush(); // first, so a crash cannot lose the documents' vectors unnoticed
+            drop_vectors();
+        }
+        reembed_needed = fs::exists(pending_path);
+
+        std::string current = options.embedding_model.empty() ? model : options.embedding_model;
+        if (changed || !stamped || current != model) {
+            fs::path tmp = stamp_path;
+            tmp += ".tmp";
+            {
+                std::ofstream out(tmp, std::ios::trunc);
+                out << current << "\n" << dimension << "\n";
+            }
+            std::error_code ec;
+            fs::rename(tmp, stamp_path, ec);
+        }
+    }
+
+    void drop_vectors() {
+        fs::path dir(index_path);
+        std::error_code ec;
+        for (const char* name : {"vectors.f32", "faiss.index", "faiss_ann.index", "faiss.wal", "doc_ids.txt"}) {
+            fs::remove(dir / name, ec);
+        }
+        for (const auto& [seq, sealed] : sealed_wals()) fs::remove(sealed, ec);
+        for (const auto& file : MetaStore::files(dir, "meta")) fs::remove(file, ec);
+    }
+
+    // Hand out up to req.limit documents after the cursor that still need a
+    // vector. An empty batch ends the pass.
+    void read_reembed_batch(Request& req) {
+        auto& out = *req.reembed_batch;
+        if (!reembed_needed) return;
+        auto take = [&](MemoryIndex::Doc doc, int64_t rowid) {
+            uint64_t key = doc_key(doc.id);
+            if (doc.text.empty() || live_rows.count(key)) return; // written since the change
+#ifndef USE_SQLITE
+            if (reembed_dropped_keys.count(key)) return;
+            for (const auto& path : reembed_dropped_paths) {
+                if (doc.path == path) return;
+            }
+#endif
+            reembed_inflight[key] = doc.path;
+#ifdef USE_SQLITE
+            reembed_rowids[key] = rowid;
+#endif
+            out.push_back(std::move(doc));
+        };
+#ifdef USE_SQLITE
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql = "SELECT rowid, id, path, start_line, end_line, text, source, timestamp FROM documents WHERE rowid > ? ORDER BY rowid LIMIT ?;";
+        if (db && sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            auto text = [stmt](int col) {
+                const char* s = (const char*)sqlite3_column_text(stmt, col);
+                return std::string(s ? s : "");
+            };
+            while (out.size() < req.limit) {
+                sqlite3_bind_int64(stmt, 1, reembed_cursor);
+                sqlite3_bind_int64(stmt, 2, (sqlite3_int64)(req.limit - out.size()));
+                size_t rows = 0;
+                while (sqlite3_step(stmt) == SQLITE_ROW) {
+                    ++rows;
+                    reembed_cursor = sqlite3_column_int64(stmt, 0);
+                    take({text(1), text(2), sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4),
+                          text(5), {}, text(6), sqlite3_column_int64(stmt, 7)}, reembed_cursor);
+                }
+                sqlite3_reset(stmt);
+                if (rows == 0) break;
+            }
+        }
+        sqlite3_finalize(stmt);
+#else
+        try {
+            if (!reembed_reader && writer) reembed_reader = writer->getReader();
+            if (reembed_reader) {
+                int32_t max_doc = reembed_reader->maxDoc();
+                while (out.size() < req.limit && reembed_cursor < max_doc) {
+                    int32_t n = (int32_t)reembed_cursor++;
+                    if (reembed_reader->isDeleted(n)) continue;
+                    DocumentPtr doc = reembed_reader->document(n);
+                    std::string id = StringUtils::toUTF8(doc->get(StringUtils::toUnicode("id")));
+                    SearchResult r = lucene_result(id, doc);
+                    take({id, r.path, r.start_line, r.end_line, r.text, {}, r.source, r.timestamp}, -1);
+                }
+            }
+        } catch (const std::exception& e) {
+            spdlog::warn("Reading documents to re-embed failed: {}", e.what());
+        } catch (...) {
+            spdlog::warn("Reading documents to re-embed failed");
+        }
+#endif
+        if (!out.empty()) return;
+        // Batches handed out but never stored were abandoned by a reembed() that stopped.
+        size_t missed = reembed_failed + reembed_inflight.size();
+        if (missed == 0) {
+            finish_reembed();
+            return;
+        }
+        end_reembed_pass();
+        spdlog::warn("{} documents could not be re-embedded; they are retried on the next pass", missed);
+    }
+
+    // Add the re-embedded documents that are still current as vector rows,
+    // counting those that came back without a usable embedding.
+    void store_reembed_batch(Request& req) {
+        std::vector<const MemoryIndex::Doc*> docs;
+        std::vector<int64_t> rowids;
+        for (const auto& doc : req.docs) {
+            uint64_t key = doc_key(doc.id);
+            // Removed, or written again, while it was being embedded.
+            if (!reembed_inflight.count(key) || live_rows.count(key)) continue;
+            if ((int)doc.embedding.size() == dimension) {
+                docs.push_back(&doc);
+#ifdef USE_SQLITE
+                rowids.push_back(reembed_rowids[key]);
+#endif
+            } else {
+                ++reembed_failed;
+            }
+        }
+        for (const auto& doc : req.docs) {
+            reembed_inflight.erase(doc_key(doc.id));
+#ifdef USE_SQLITE
+            reembed_rowids.erase(doc_key(doc.id));
+#endif
+        }
+        add_docs_internal(docs, false, std::move(rowids));
+    }
+
+    // Leave the marker in place; the next pass starts from the beginning.
+    void end_reembed_pass() {
+        reembed_inflight.clear();
+        reembed_cursor = 0;
+        reembed_failed = 0;
+#ifdef USE_SQLITE
+        reembed_rowids.clear();
+#else
+        try {
+            if (reembed_reader) reembed_reader->close();
+        } catch (...) {}
+        reembed_reader.reset();
+        reembed_dropped_keys.clear();
+        reembed_dropped_paths.clear();
+#endif
+    }
+
+    void finish_reembed() {
+        end_reembed_pass();
+        if (reembed_needed.exchange(false)) {
+            std::error_code ec;
+            fs::remove(fs::path(index_path) / "reembed.pending", ec);
+            spdlog::info("Re-embedding finished");
+        }
+    }
+
+    // Rows indexed before the metadata store existed (or lost in a crash
+    // between the vectors and meta.bin) are recovered from the keyword
+    // backend once at startup, keeping meta row-aligned with faiss_index.
+    // Their ids come from the replayed WAL, or from the doc_ids.txt older
+    // versions kept; a row with neither is tombstoned.
+    void backfill_meta() {
+        size_t total = (size_t)faiss_index->ntotal;
+        fs::path legacy_ids = fs::path(index_path) / "doc_ids.txt";
+        std::error_code ec;
+        if (meta->size() >= total) {
+            fs::remove(legacy_ids, ec); // meta.bin has every id now
+            return;
+        }
+        size_t from = meta->size();
+        std::vector<std::string> legacy;
+        if (recovered_ids.size() < total - from) {
+            std::ifstream f(legacy_ids);
+            std::string line;
+            while (std::getline(f, line)) legacy.push_back(line);
+        }
+        std::map<std::string, std::pair<SearchResult, int64_t>> found;
+        ReadContext ctx;
+#ifdef USE_SQLITE
+        ctx.db = db;
+#endif
+        for (size_t row = from; row < total; ++row) {
+            std::string id;
+            if (auto rec = recovered_ids.find((faiss::idx_t)row); rec != recovered_ids.end()) id = rec->second;
+            else if (row < legacy.size()) id = legacy[row];
+            if (!id.empty() && !found.count(id)) fetch_metadata_from_backend(ctx, id, found);
+            auto it = id.empty() ? found.end() : found.find(id);
+            if (it != found.end()) {
+                const auto& [r, text_rowid] = it->second;
+                meta->append(id, r.path, r.start_line, r.end_line, r.text, r.source,
+                             r.timestamp ? r.timestamp : date_from_path(r.path), r.text.empty() ? -1 : text_rowid);
+            } else {
+                meta->append(id, "", 0, 0, "", "", 0);
+                if (id.empty()) meta->remove(row);
+            }
+        }
+        meta->flush();
+#ifdef USE_SQLITE
+        finalize_read_stmts(ctx);
+#endif
+        recovered_ids.clear();
+        fs::remove(legacy_ids, ec);
+        spdlog::info("Backfilled metadata for {} vectors", total - from);
+    }
+
+    // Each found id maps to its metadata and, under SQLite, its documents rowid.
+    void fetch_metadata_from_backend(ReadContext& ctx, const std::string& id,
+                                     std::map<std::string, std::pair<SearchResult, int64_t>>& metadata) {
+#ifdef USE_SQLITE
+        sqlite3* db = ctx.db;
+        if (!db) return;
+        const char* sql = "SELECT path, start_line, end_line, text, source, timestamp, rowid FROM documents WHERE id = ? LIMIT 1;";
+        if (sqlite3_stmt* stmt = cached_stmt(db, ctx.by_id_stmt, sql)) {
+            sqlite3_bind_text(stmt, 1, id.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                metadata[id] = {{
+                    id,
+                    (const char*)sqlite3_column_text(stmt, 0),
+                    sqlite3_column_int(stmt, 1),
+                    sqlite3_column_int(stmt, 2),
+                    (const char*)sqlite3_column_text(stmt, 3),
+                    0.0f,
+                    (const char*)sqlite3_column_text(stmt, 4),
+                    sqlite3_column_int64(stmt, 5)
+                }, sqlite3_column_int64(stmt, 6)};
+            }
+            sqlite3_reset(stmt);
+        }
+#else
+        try {
+            PinnedSearcher pinned = acquire_searcher();
+            if (IndexSearcherPtr searcher = pinned.searcher) {
+                TermPtr term = newLucene<Term>(StringUtils::toUnicode("id"), StringUtils::toUnicode(id));
+                QueryPtr query = newLucene<TermQuery>(term);
+                TopDocsPtr top_docs = searcher->search(query, 1);
+                
+                if (top_docs->totalHits > 0) {
+                    DocumentPtr doc = searcher->doc(top_docs->scoreDocs[0]->doc);
+                    metadata[id] = {lucene_result(id, doc), -1};
+                }
+            }
+        } catch (...) {
+            // Silently fail if metadata can't be fetched
+        }
+#endif
+    }
+
+    // Per-source fusion weight and decay rate (ln 2 / half-life, per day), resolved once.
+    struct SourcePolicy {
+        float weight = 1.0f;
+        float decay_rate = 0.0f;
+    };
+    std::map<std::string, SourcePolicy> source_policies;
+    SourcePolicy default_policy;
+    bool decay_enabled = false; // any source decays; only then are shards worth keeping
+
+    void init_source_policies() {
+        const auto& decay = options.decay_half_life_days;
+        const auto& weights = options.source_weights;
+        auto policy_for = [&](const std::string& source) {
+            SourcePolicy p;
+            auto d = decay.find(source);
+            if (d == decay.end()) d = decay.find("default");
+            if (d != decay.end() && d->second > 0) p.decay_rate = (float)(std::log(2.0) / d->second);
+            auto w = weights.find(source);
+            if (w != weights.end()) p.weight = w->second;
+            return p;
+        };
+        default_policy = policy_for("default");
+        for (const auto& [source, days] : decay) source_policies[source] = policy_for(source);
+        for (const auto& [source, weight] : weights) source_policies[source] = policy_for(source);
+        decay_enabled = default_policy.decay_rate > 0;
+        for (const auto& [source, p] : source_policies) decay_enabled = decay_enabled || p.decay_rate > 0;
+    }
+
+    const SourcePolicy& source_policy(const std::string& source) const {
+        auto it = source_policies.find(source);
+        return it != source_policies.end() ? it->second : default_policy;
+    }
+
+    // exp(-rate * age_days) for one timestamp; undated rows do not decay.
+    static float decay_factor(int64_t stamp, float rate, double now) {
+        if (stamp <= 0 || rate <= 0) return 1.0f;
+        return std::exp(-rate * (float)std::max(0.0, (now - (double)stamp) / 86400.0));
+    }
+
+    // factors[i] *= exp(-rates[i] * age_days). Ages are gathered first so the
+    // decay itself is one pass over flat arrays.
+    static void apply_temporal_decay(const std::vector<int64_t>& stamps, const std::vector<float>& rates, std::vector<float>& factors) {
+        size_t n = stamps.size();
+        double now = (double)std::time(nullptr);
+        std::vector<float> exponent(n);
+        for (size_t i = 0; i < n; ++i) {
+            if (stamps[i] <= 0) continue; // undated: no decay
+            exponent[i] = -rates[i] * (float)std::max(0.0, (now - (double)stamps[i]) / 86400.0);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            factors[i] *= std::exp(exponent[i]);
+        }
+    }
+};
+
+int64_t date_from_path(std::string_view path) {
+    auto digits = [&](size_t at, size_t len) {
+        int v = 0;
+        for (size_t k = at; k < at + len; ++k) {
+            if (path[k] < '0' || path[k] > '9') return -1;
+            v = v * 10 + (path[k] - '0');
+        }
+        return v;
+    };
+    for (size_t i = 0; i + 10 <= path.size(); ++i) {
+        if (path[i + 4] != '-' || path[i + 7] != '-') continue;
+        int y = digits(i, 4), m = digits(i + 5, 2), d = digits(i + 8, 2);
+        if (y < 1970 || m < 1 || m > 12 || d < 1 || d > 31) continue;
+        // Days since 1970-01-01 in the proleptic Gregorian calendar.
+        int yy = m <= 2 ? y - 1 : y;
+        int era = yy / 400;
+        int yoe = yy - era * 400;
+        int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        int64_t days = (int64_t)era * 146097 + doe - 719468;
+        return days * 86400;
+    }
+    return 0;
 }
 
-std::vector<SearchResult> MemoryIndex::search(
-    const std::string& query,
-    const std::vector<float>& query_embedding,
-    int top_k
-) {
-    std::vector<SearchResult> results;
-    Impl::Request req;
-    req.type = Impl::Request::SEARCH;
-    req.query = query;
-    req.query_embedding = query_embedding;
-    req.top_k = top_k;
-    req.search_results = &results;
-    
+MemoryIndex::MemoryIndex(const std::string& index_path, int dimension)
+    : impl_(std::make_unique<Impl>(index_path, dimension, MemoryIndexOptions{})) {}
+
+MemoryIndex::MemoryIndex(const fs::path& index_path, int dimension)
+    : impl_(std::make_unique<Impl>(index_path.string(), dimension, MemoryIndexOptions{})) {}
+
+MemoryIndex::MemoryIndex(const fs::path& index_path, int dimension, const MemoryIndexOptions& options)
+    : impl_(std::make_unique<Impl>(index_path.string(), dimension, options)) {}
+
+MemoryIndex::~MemoryIndex() = default;
+
+std::shared_ptr<MemoryIndex> MemoryIndex::open_shared(const fs::path& index_path, int dimension,
+                                                      const MemoryIndexOptions& options) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<MemoryIndex>> open;
+    std::error_code ec;
+    fs::path key = fs::absolute(index_path, ec);
+    key = fs::weakly_canonical(key, ec);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = open[key.string()];
+    if (auto index = slot.lock()) {
+        if (index->impl_->dimension != dimension) {
+            spdlog::warn("Index {} is open with dimension {}, not {}", key.string(), index->impl_->dimension, dimension);
+        }
+        if (!(index->impl_->options == options)) {
+            spdlog::warn("Index {} is already open with other options; those stay in effect", key.string());
+        }
+        return index;
+    }
+    auto index = std::make_shared<MemoryIndex>(index_path, dimension, options);
+    slot = index;
+    return index;
+}
+
+void MemoryIndex::Impl::submit(Request req) {
+    await([&](std::function<void()> done) {
+        req.on_complete = std::move(done);
+        enqueue(std::move(req));
+    });
+}
+
+void MemoryIndex::Impl::await(const std::function<void(std::function<void()>)>& start) {
     auto calling_fiber = fiber_ident();
     auto calling_node = FiberNode::current();
 
     if (calling_node) {
-        req.on_complete = [calling_node, calling_fiber]() {
+        start([calling_node, calling_fiber]() {
             calling_node->spawn([calling_fiber]() {
                 fiber_resume(calling_fiber);
             });
-        };
-        {
-            std::lock_guard<std::mutex> lock(impl_->queue_mutex);
-            impl_->queue.push(std::move(req));
-        }
-        impl_->queue_cv.notify_one();
+        });
         fiber_suspend(0);
     } else {
         std::condition_variable cv;
         std::mutex mtx;
         bool done = false;
-        req.on_complete = [&cv, &mtx, &done]() {
-            {
-                std::lock_guard<std::mutex> lock(mtx);
-                done = true;
-            }
+        start([&cv, &mtx, &done]() {
+            // Notify under the lock: the waiter owns cv and may destroy it
+            // as soon as it observes done.
+            std::lock_guard<std::mutex> lock(mtx);
+            done = true;
             cv.notify_one();
-        };
-        {
-            std::lock_guard<std::mutex> lock(impl_->queue_mutex);
-            impl_->queue.push(std::move(req));
-        }
-        impl_->queue_cv.notify_one();
+        });
         std::unique_lock<std::mutex> lock(mtx);
         cv.wait(lock, [&done] { return done; });
     }
+}
+
+std::vector<SearchResult> MemoryIndex::Impl::run_search(const std::string& query, const std::vector<float>& embedding,
+                                                        int top_k, const SearchFilter& filter) {
+    std::vector<SearchResult> results;
+    Request req;
+    req.type = Request::SEARCH;
+    req.query = query;
+    req.query_embedding = embedding;
+    req.top_k = top_k;
+    req.filter = filter;
+    req.search_results = &results;
+    submit(std::move(req));
+    return results;
+}
+
+std::vector<SearchResult> MemoryIndex::Impl::cached_search(const std::string& query, const std::vector<float>* embedding,
+                                                           const std::function<std::vector<float>()>* embed,
+                                                           int top_k, const SearchFilter& filter) {
+    std::vector<float> computed;
+    auto embedding_for = [&]() -> const std::vector<float>& {
+        if (embedding) return *embedding;
+        if (embed && *embed) computed = (*embed)();
+        return computed;
+    };
+    if (!cache) return run_search(query, embedding_for(), top_k, filter);
+
+    std::string key = SearchCache::key(query, embedding, top_k, filter);
+    uint64_t gen = generation.load();
+    std::vector<SearchResult> results;
+    if (cache->get(key, gen, results)) return results;
+
+    auto [flight, leader] = cache->join(key, gen);
+    if (!leader) {
+        await([&](std::function<void()> done) { cache->wait(flight, std::move(done)); });
+        return flight->results;
+    }
+    bool cacheable = true;
+    try {
+        const std::vector<float>& emb = embedding_for();
+        // A failed embedding leaves a keyword-only result; serve it, but do
+        // not keep it once the embedder recovers.
+        cacheable = embedding || !embed || !*embed || !emb.empty();
+        results = run_search(query, emb, top_k, filter);
+    } catch (...) {
+        cache->finish(key, gen, flight, {}, false);
+        throw;
+    }
+    cache->finish(key, gen, flight, results, cacheable);
     return results;
 }
 
+void MemoryIndex::add_document(
+    const std::string& id,
+    const std::string& path,
+    int start_line,
+    int end_line,
+    const std::string& text,
+    const std::vector<float>& embedding,
+    const std::string& source,
+    int64_t timestamp
+) {
+    Doc doc{id, path, start_line, end_line, text, embedding, source, timestamp};
+    add_documents(std::span<const Doc>(&doc, 1));
+}
+
+void MemoryIndex::add_documents(std::span<const Doc> docs) {
+    if (docs.empty()) return;
+    Impl::Request req;
+    req.type = Impl::Request::ADD;
+    req.docs = docs;
+    impl_->submit(std::move(req));
+}
+
+void MemoryIndex::upsert_document(
+    const std::string& id,
+    const std::string& path,
+    int start_line,
+    int end_line,
+    const std::string& text,
+    const std::vector<float>& embedding,
+    const std::string& source,
+    int64_t timestamp
+) {
+    Doc doc{id, path, start_line, end_line, text, embedding, source, timestamp};
+    Impl::Request req;
+    req.type = Impl::Request::ADD;
+    req.docs = std::span<const Doc>(&doc, 1);
+    req.replace = true;
+    impl_->submit(std::move(req));
+}
+
+void MemoryIndex::replace_path(const std::string& path, std::span<const Doc> docs) {
+    Impl::Request req;
+    req.type = Impl::Request::ADD;
+    req.docs = docs;
+    req.replace_path = path;
+    impl_->submit(std::move(req));
+}
+
+void MemoryIndex::remove_document(const std::string& id) {
+    Impl::Request req;
+    req.type = Impl::Request::REMOVE;
+    req.doc_id = id;
+    impl_->submit(std::move(req));
+}
+
+std::vector<SearchResult> MemoryIndex::search(
+    const std::string& query,
+    const std::vector<float>& query_embedding,
+    int top_k,
+    const SearchFilter& filter
+) {
+    return impl_->cached_search(query, &query_embedding, nullptr, top_k, filter);
+}
+
+std::vector<SearchResult> MemoryIndex::search_query(
+    const std::string& query,
+    const std::function<std::vector<float>()>& embed,
+    int top_k,
+    const SearchFilter& filter
+) {
+    return impl_->cached_search(query, nullptr, &embed, top_k, filter);
+}
+
 void MemoryIndex::clear() {
     Impl::Request req;
     req.type = Impl::Request::CLEAR;
-    
-    auto calling_fiber = fiber_ident();
-    auto calling_node = FiberNode::current();
+    impl_->submit(std::move(req));
+}
 
-    if (calling_node) {
-        req.on_complete = [calling_node, calling_fiber]() {
-            calling_node->spawn([calling_fiber]() {
-                fiber_resume(calling_fiber);
-            });
-        };
-        {
-            std::lock_guard<std::mutex> lock(impl_->queue_mutex);
-            impl_->queue.push(std::move(req));
-        }
-        impl_->queue_cv.notify_one();
-        fiber_suspend(0);
+// Sleep without holding up the other fibers on this thread.
+static void pause(std::chrono::microseconds duration) {
+    if (FiberNode::current() && fiber_ident()) {
+        fiber_usleep((int64_t)duration.count());
     } else {
-        std::condition_variable cv;
-        std::mutex mtx;
-        bool done = false;
-        req.on_complete = [&cv, &mtx, &done]() {
-            {
-                std::lock_guard<std::mutex> lock(mtx);
-                done = true;
+        std::this_thread::sleep_for(duration);
+    }
+}
+
+bool MemoryIndex::reembed_pending() const {
+    return impl_->reembed_needed;
+}
+
+size_t MemoryIndex::reembed(const BatchEmbedFn& embed, size_t batch_size, double max_per_sec) {
+    if (!embed || !impl_->reembed_needed || impl_->reembed_running.exchange(true)) return 0;
+    spdlog::info("Re-embedding stored documents");
+    auto started = std::chrono::steady_clock::now();
+    size_t read = 0;
+    size_t embedded = 0;
+    try {
+        while (true) {
+            std::vector<Doc> batch;
+            Impl::Request next;
+            next.type = Impl::Request::REEMBED_READ;
+            next.reembed_batch = &batch;
+            next.limit = std::max<size_t>(batch_size, 1);
+            impl_->submit(std::move(next));
+            if (batch.empty()) break;
+
+            std::vector<std::string> texts;
+            texts.reserve(batch.size());
+            for (const auto& doc : batch) texts.push_back(doc.text);
+            auto embeddings = embed(texts);
+            for (size_t i = 0; i < batch.size() && i < embeddings.size(); ++i) {
+                if ((int)embeddings[i].size() == impl_->dimension) ++embedded;
+                batch[i].embedding = std::move(embeddings[i]);
+            }
+            read += batch.size();
+
+            Impl::Request store;
+            store.type = Impl::Request::REEMBED_STORE;
+            store.docs = batch;
+            impl_->submit(std::move(store));
+
+            // Hold the average rate since the start under max_per_sec.
+            if (max_per_sec > 0) {
+                auto due = started + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         std::chrono::duration<double>(read / max_per_sec));
+                auto now = std::chrono::steady_clock::now();
+                if (due > now) pause(std::chrono::duration_cast<std::chrono::microseconds>(due - now));
             }
-            cv.notify_one();
-        };
-        {
-            std::lock_guard<std::mutex> lock(impl_->queue_mutex);
-            impl_->queue.push(std::move(req));
         }
-        impl_->queue_cv.notify_one();
-        std::unique_lock<std::mutex> lock(mtx);
-        cv.wait(lock, [&done] { return done; });
+        spdlog::info("Re-embedded {} of {} documents", embedded, read);
+    } catch (const std::exception& e) {
+        spdlog::warn("Re-embedding stopped after {} documents: {}", read, e.what());
     }
+    impl_->reembed_running = false;
+    return embedded;
 }
@@ -5,6 +5,10 @@
 #include <memory>
 #include <map>
 #include <filesystem>
+#include <span>
+#include <cstdint>
+#include <string_view>
+#include <functional>
 
 namespace fs = std::filesystem;
 
@@ -16,14 +20,142 @@ struct SearchResult {
     std::string text;
     float score;
     std::string source; // "sessions", "memory", "long-term"
+    int64_t timestamp = 0; // document date (epoch seconds); 0 if undated
+};
+
+// Restricts a search to matching documents, inside both the vector and the
+// keyword search. Empty fields match everything; a time bound never matches
+// an undated document.
+struct SearchFilter {
+    std::vector<std::string> sources; // any of "sessions", "memory", "long-term"
+    std::string session;              // session key; matches path "session:<key>"
+    std::string path_prefix;
+    int64_t since = 0;                // epoch seconds, inclusive; 0 = unbounded
+    int64_t until = 0;
+
+    bool empty() const {
+        return sources.empty() && session.empty() && path_prefix.empty() && since == 0 && until == 0;
+    }
+
+    bool matches_source(const std::string& source) const {
+        if (sources.empty()) return true;
+        for (const auto& s : sources) if (s == source) return true;
+        return false;
+    }
+
+    bool matches_path(const std::string& path) const {
+        if (!session.empty() && path != "session:" + session) return false;
+        return path.compare(0, path_prefix.size(), path_prefix) == 0;
+    }
+
+    bool matches_time(int64_t timestamp) const {
+        if (since == 0 && until == 0) return true;
+        return timestamp > 0 && timestamp >= since && (until == 0 || timestamp <= until);
+    }
+
+    bool matches(const SearchResult& r) const {
+        return matches_source(r.source) && matches_path(r.path) && matches_time(r.timestamp);
+    }
+};
+
+// Epoch seconds (UTC midnight) of the first YYYY-MM-DD in `text`, or 0.
+int64_t date_from_path(std::string_view text);
+
+// Vector index tuning. "flat" is an exact IndexFlatIP scan; "hnsw" and "ivfpq"
+// are approximate indexes built in the background once the corpus is large
+// enough, with the flat index serving queries until they are ready.
+struct MemoryIndexOptions {
+    // Embedding model the vectors come from. Opening an index whose vectors
+    // were made by another model, or at another dimension, drops them and
+    // leaves the documents to MemoryIndex::reembed(). Empty: not tracked.
+    std::string embedding_model;
+
+    std::string index_type = "flat"; // "flat", "hnsw", "ivfpq"
+    int hnsw_m = 32;
+    int hnsw_ef_construction = 40;
+    int hnsw_ef_search = 64;
+    int ivf_nlist = 1024;
+    int ivf_nprobe = 16;
+    int pq_m = 64;                   // sub-quantizers, rounded down to a divisor of the dimension
+    int pq_nbits = 8;
+    int ann_min_vectors = 20000;     // below this the flat scan is cheaper than training
+
+    // Flat index encoding. "fp16" halves and "sq8" quarters resident memory;
+    // both keep a full-precision copy in an mmap'd side file and re-score the
+    // best candidate_k * rerank_factor quantized hits from it.
+    std::string vector_storage = "fp32"; // "fp32", "fp16", "sq8"
+    int rerank_factor = 4;
+
+    // A background checkpoint runs once this many vector bytes, or this old,
+    // await one: fp32 storage fsyncs vectors.f32 and the metadata, quantized
+    // storage folds its WAL into the on-disk index.
+    uint64_t wal_checkpoint_bytes = 64ull << 20;
+    int wal_checkpoint_interval_sec = 600;
+
+    // Keyword index writes are group-committed at most this often.
+    int keyword_commit_interval_ms = 1000;
+
+    // Searches are served by this many reader threads, concurrently with each
+    // other and never queued behind writes.
+    int search_threads = 2;
+
+    // A decayed search scans month/source shards newest first and stops once
+    // older ones cannot reach the top k; they are shared out with this many
+    // helper threads.
+    int shard_search_threads = 2;
+
+    // Recent results kept per index, keyed by normalized query, embedding,
+    // top_k and filter, and dropped by any write; identical searches running
+    // at once share one execution. 0 disables the cache.
+    int search_cache_entries = 256;
+
+    // Temporal decay half-life in days, per source; "default" covers sources
+    // not listed and 0 disables decay. Undated documents never decay.
+    std::map<std::string, double> decay_half_life_days = {
+        {"default", 30.0}, {"sessions", 0.0}, {"long-term", 0.0}};
+
+    // Reciprocal rank fusion: each list adds weight / (rrf_k + rank), and the
+    // sum is scaled by the document's source weight (1 if not listed).
+    int rrf_k = 60;
+    float vector_weight = 0.7f;
+    float keyword_weight = 0.3f;
+    std::map<std::string, float> source_weights;
+
+    // Removed and replaced documents stay in the vector index as tombstones,
+    // hidden from searches, until they make up this share of the rows; the
+    // index is then rebuilt without them in the background.
+    double compact_tombstone_ratio = 0.25;
+    int compact_min_tombstones = 32;
+
+    bool operator==(const MemoryIndexOptions&) const = default;
 };
 
 class MemoryIndex {
 public:
+    struct Doc {
+        std::string id;
+        std::string path;
+        int start_line = 0;
+        int end_line = 0;
+        std::string text;
+        std::vector<float> embedding;
+        std::string source;
+        int64_t timestamp = 0; // epoch seconds; 0 takes a YYYY-MM-DD date from path
+    };
+
     explicit MemoryIndex(const std::string& index_path, int dimension = 1536);
     explicit MemoryIndex(const fs::path& index_path, int dimension = 1536);
+    MemoryIndex(const fs::path& index_path, int dimension, const MemoryIndexOptions& options);
     ~MemoryIndex();
 
+    // The index open on `index_path` in this process, opening it if needed.
+    // Every agent and subagent in a workspace shares one instance: opening is
+    // the only O(corpus) step, and the files allow a single writer. The first
+    // opener's dimension and options win; later callers asking for others
+    // get the open index and a warning.
+    static std::shared_ptr<MemoryIndex> open_shared(const fs::path& index_path, int dimension,
+                                                    const MemoryIndexOptions& options);
+
     void add_document(
         const std::string& id,
         const std::string& path,
@@ -31,17 +163,69 @@ public:
         int end_line,
         const std::string& text,
         const std::vector<float>& embedding,
-        const std::string& source
+        const std::string& source,
+        int64_t timestamp = 0
+    );
+
+    // Index many documents in one worker batch: a single Faiss add, WAL flush
+    // and keyword-index transaction for the whole span.
+    void add_documents(std::span<const Doc> docs);
+
+    // Replace every document stored under `id` (if any) with this one.
+    void upsert_document(
+        const std::string& id,
+        const std::string& path,
+        int start_line,
+        int end_line,
+        const std::string& text,
+        const std::vector<float>& embedding,
+        const std::string& source,
+        int64_t timestamp = 0
     );
 
+    // Drop every document stored under `id` from both indexes.
+    void remove_document(const std::string& id);
+
+    // Replace everything stored under `path` with `docs` in one worker batch,
+    // so searches see either the old chunks of a file or the new ones.
+    void replace_path(const std::string& path, std::span<const Doc> docs);
+
     std::vector<SearchResult> search(
         const std::string& query,
         const std::vector<float>& query_embedding,
-        int top_k = 10
+        int top_k = 10,
+        const SearchFilter& filter = {}
+    );
+
+    // As search(), but `embed` is only called when the result is not cached,
+    // so a repeated query skips its embedding request. The query text stands
+    // in for the embedding in the cache key.
+    std::vector<SearchResult> search_query(
+        const std::string& query,
+        const std::function<std::vector<float>()>& embed,
+        int top_k = 10,
+        const SearchFilter& filter = {}
     );
 
     void clear();
 
+    // One embedding per text, empty where embedding failed.
+    using BatchEmbedFn = std::function<std::vector<std::vector<float>>(const std::vector<std::string>&)>;
+
+    // True while documents stored before an embedding change are waiting to
+    // be re-embedded. Until they are, they are found by keyword search only.
+    bool reembed_pending() const;
+
+    // Re-embed those documents: their text is streamed out of the keyword
+    // index `batch_size` at a time, embedded at no more than `max_per_sec`
+    // documents a second (0: unlimited), and each batch joins the vector
+    // index as it completes, while searches and writes carry on. Blocks the
+    // calling fiber (or thread) for one pass over them, and returns at once if
+    // none are pending or another caller is already at it. Documents whose
+    // embedding fails stay pending for the next call. Returns the number of
+    // documents given a vector.
+    size_t reembed(const BatchEmbedFn& embed, size_t batch_size = 256, double max_per_sec = 0);
+
 private:
     struct Impl;
     std::unique_ptr<Impl> impl_;
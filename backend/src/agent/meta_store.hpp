@@ -0,0 +1,326 @@
+#pragma once
+// MetaStore — per-row document metadata for MemoryIndex, keyed by Faiss row.
+//
+//   meta.bin   fixed-width records (line range, timestamp, string offsets)
+//   meta.blob  id / path / source / text bytes, memory-mapped for reads
+//   meta.del   rows that have been deleted, appended as u64
+//
+// Records are decoded into columns at startup so fusion and filtering are
+// plain array lookups; text stays in the mapped blob until a result is built.
+// A row may instead name the keyword backend's row holding its text (the
+// SQLite `documents` rowid), so the text is stored once.
+// Writes are appended and become readable after flush().
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.hpp"
+#include "memory_index.hpp"
+#include "rank_fusion.hpp"
+
+namespace fs = std::filesystem;
+
+class MetaStore {
+public:
+    // `stem` names the files; compaction builds a replacement under another stem.
+    explicit MetaStore(const fs::path& dir, const std::string& stem = "meta")
+        : meta_path_(dir / (stem + ".bin")), blob_path_(dir / (stem + ".blob")), del_path_(dir / (stem + ".del")) {
+        load();
+        meta_out_.open(meta_path_, std::ios::binary | std::ios::app);
+        blob_out_.open(blob_path_, std::ios::binary | std::ios::app);
+        del_out_.open(del_path_, std::ios::binary | std::ios::app);
+    }
+
+    size_t size() const { return blob_off_.size(); }
+
+    static std::vector<fs::path> files(const fs::path& dir, const std::string& stem) {
+        return {dir / (stem + ".bin"), dir / (stem + ".blob"), dir / (stem + ".del")};
+    }
+
+    // With `text_rowid` >= 0 the text lives in that row of the keyword
+    // backend and is not written here.
+    void append(const std::string& id, const std::string& path, int start_line, int end_line,
+                const std::string& text, const std::string& source, int64_t timestamp, int64_t text_rowid = -1) {
+        std::string_view stored = text_rowid >= 0 ? std::string_view() : std::string_view(text);
+        Record rec{};
+        rec.blob_off = blob_size_;
+        rec.id_len = (uint32_t)id.size();
+        rec.path_len = (uint32_t)path.size();
+        rec.source_len = (uint32_t)source.size();
+        rec.text_len = (uint32_t)stored.size();
+        rec.start_line = start_line;
+        rec.end_line = end_line;
+        rec.timestamp = timestamp;
+        rec.text_rowid = text_rowid;
+
+        blob_out_.write(id.data(), id.size());
+        blob_out_.write(path.data(), path.size());
+        blob_out_.write(source.data(), source.size());
+        blob_out_.write(stored.data(), stored.size());
+        meta_out_.write(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        blob_size_ += rec.id_len + rec.path_len + rec.source_len + rec.text_len;
+
+        push_columns(rec, doc_key(id), intern(path_ids_, paths_, path), intern(source_ids_, sources_, source));
+    }
+
+    // Tombstone a row. It keeps its slot until the index is compacted.
+    void remove(size_t row) {
+        if (row >= size() || deleted_[row]) return;
+        uint64_t r = row;
+        del_out_.write(reinterpret_cast<const char*>(&r), sizeof(r));
+        deleted_[row] = 1;
+        ++deleted_count_;
+    }
+
+    // Tombstone every live row under `path`, returning them; the path's row
+    // list makes this independent of the size of the corpus.
+    std::vector<size_t> remove_path(const std::string& path) {
+        std::vector<size_t> removed;
+        auto it = path_ids_.find(path);
+        if (it == path_ids_.end()) return removed;
+        for (size_t row : path_rows_[it->second]) {
+            if (deleted_[row]) continue;
+            remove(row);
+            removed.push_back(row);
+        }
+        path_rows_[it->second].clear();
+        return removed;
+    }
+
+    bool deleted(size_t row) const { return deleted_[row] != 0; }
+    size_t deleted_count() const { return deleted_count_; }
+
+    // Make appended rows durable in the OS and visible to readers.
+    void flush() {
+        meta_out_.flush();
+        blob_out_.flush();
+        del_out_.flush();
+        if (blob_.size() < blob_size_) blob_.grow();
+    }
+
+    // Drop rows past `rows` (the vector index is the source of truth for row count).
+    void truncate(size_t rows) {
+        if (rows >= size()) return;
+        meta_out_.close();
+        std::error_code ec;
+        fs::resize_file(meta_path_, rows * sizeof(Record), ec);
+        meta_out_.open(meta_path_, std::ios::binary | std::ios::app);
+        blob_off_.resize(rows);
+        key_.resize(rows);
+        text_len_.resize(rows);
+        text_rowid_.resize(rows);
+        id_len_.resize(rows);
+        path_idx_.resize(rows);
+        source_idx_.resize(rows);
+        start_line_.resize(rows);
+        end_line_.resize(rows);
+        timestamp_.resize(rows);
+        deleted_count_ -= std::count(deleted_.begin() + rows, deleted_.end(), 1);
+        deleted_.resize(rows);
+        for (auto& list : path_rows_) {
+            while (!list.empty() && list.back() >= rows) list.pop_back();
+        }
+        del_out_.close();
+        rewrite_deleted();
+        del_out_.open(del_path_, std::ios::binary | std::ios::app);
+    }
+
+    void reset() {
+        meta_out_.close();
+        blob_out_.close();
+        del_out_.close();
+        blob_.close();
+        std::error_code ec;
+        fs::remove(meta_path_, ec);
+        fs::remove(blob_path_, ec);
+        fs::remove(del_path_, ec);
+        blob_off_.clear();
+        key_.clear();
+        text_len_.clear();
+        text_rowid_.clear();
+        id_len_.clear();
+        path_idx_.clear();
+        source_idx_.clear();
+        start_line_.clear();
+        end_line_.clear();
+        timestamp_.clear();
+        deleted_.clear();
+        deleted_count_ = 0;
+        blob_size_ = 0;
+        for (auto& list : path_rows_) list.clear();
+        meta_out_.open(meta_path_, std::ios::binary | std::ios::app);
+        blob_out_.open(blob_path_, std::ios::binary | std::ios::app);
+        del_out_.open(del_path_, std::ios::binary | std::ios::app);
+    }
+
+    // ── Column access ────────────────────────────────────────────────────────
+
+    std::string_view id(size_t row) const { return blob_view(blob_off_[row], id_len_[row]); }
+    uint64_t key(size_t row) const { return key_[row]; } // doc_key(id(row))
+    const std::string& path(size_t row) const { return paths_[path_idx_[row]]; }
+    const std::string& source(size_t row) const { return sources_[source_idx_[row]]; }
+    int start_line(size_t row) const { return start_line_[row]; }
+    int end_line(size_t row) const { return end_line_[row]; }
+    int64_t timestamp(size_t row) const { return timestamp_[row]; }
+
+    // Dictionary indexes, so filters test each distinct path or source once.
+    uint32_t path_index(size_t row) const { return path_idx_[row]; }
+    uint32_t source_index(size_t row) const { return source_idx_[row]; }
+    const std::vector<std::string>& paths() const { return paths_; }
+    const std::vector<std::string>& sources() const { return sources_; }
+
+    // Empty for a row whose text is in the keyword backend; see text_rowid().
+    std::string_view text(size_t row) const {
+        const std::string& p = path(row);
+        const std::string& s = source(row);
+        return blob_view(blob_off_[row] + id_len_[row] + p.size() + s.size(), text_len_[row]);
+    }
+    int64_t text_rowid(size_t row) const { return text_rowid_[row]; } // -1: text is in the blob
+    bool has_text(size_t row) const { return text_len_[row] > 0 || text_rowid_[row] >= 0; }
+
+    SearchResult result(size_t row) const {
+        return {
+            std::string(id(row)),
+            path(row),
+            start_line(row),
+            end_line(row),
+            std::string(text(row)),
+            0.0f,
+            source(row),
+            timestamp(row)
+        };
+    }
+
+private:
+#pragma pack(push, 1)
+    struct Record {
+        uint64_t blob_off;
+        uint32_t id_len;
+        uint32_t path_len;
+        uint32_t source_len;
+        uint32_t text_len;
+        int32_t start_line;
+        int32_t end_line;
+        int64_t timestamp;
+        int64_t text_rowid;
+    };
+#pragma pack(pop)
+    static_assert(sizeof(Record) == 48, "meta.bin record layout changed");
+
+    void load() {
+        std::error_code ec;
+        blob_size_ = fs::exists(blob_path_, ec) ? fs::file_size(blob_path_, ec) : 0;
+        blob_.open(blob_path_);
+
+        MappedFile meta(meta_path_);
+        if (!meta.is_open()) return;
+
+        size_t rows = meta.size() / sizeof(Record);
+        const auto* recs = reinterpret_cast<const Record*>(meta.data());
+        for (size_t i = 0; i < rows; ++i) {
+            const Record& rec = recs[i];
+            if (rec.blob_off + rec.id_len + rec.path_len + rec.source_len + rec.text_len > blob_size_) {
+                // The blob write did not make it to disk; drop the torn tail.
+                rows = i;
+                break;
+            }
+            std::string path(blob_view(rec.blob_off + rec.id_len, rec.path_len));
+            std::string source(blob_view(rec.blob_off + rec.id_len + rec.path_len, rec.source_len));
+            push_columns(rec, doc_key(blob_view(rec.blob_off, rec.id_len)), intern(path_ids_, paths_, path), intern(source_ids_, sources_, source));
+        }
+        if (rows * sizeof(Record) != meta.size()) {
+            meta.close();
+            fs::resize_file(meta_path_, rows * sizeof(Record), ec);
+        }
+
+        std::ifstream del(del_path_, std::ios::binary);
+        uint64_t row = 0;
+        bool stale = false;
+        while (del.read(reinterpret_cast<char*>(&row), sizeof(row))) {
+            if (row >= size()) {
+                stale = true;
+            } else if (!deleted_[row]) {
+                deleted_[row] = 1;
+                ++deleted_count_;
+            }
+        }
+        del.close();
+        // Rows past the end were lost with a torn tail and will be re-added
+        // under the same numbers, so their tombstones must not survive.
+        if (stale) rewrite_deleted();
+    }
+
+    void rewrite_deleted() {
+        std::ofstream out(del_path_, std::ios::binary | std::ios::trunc);
+        for (uint64_t row = 0; row < deleted_.size(); ++row) {
+            if (deleted_[row]) out.write(reinterpret_cast<const char*>(&row), sizeof(row));
+        }
+    }
+
+    void push_columns(const Record& rec, uint64_t key, uint32_t path_idx, uint32_t source_idx) {
+        if (path_rows_.size() <= path_idx) path_rows_.resize(path_idx + 1);
+        path_rows_[path_idx].push_back(blob_off_.size());
+        blob_off_.push_back(rec.blob_off);
+        key_.push_back(key);
+        id_len_.push_back(rec.id_len);
+        text_len_.push_back(rec.text_len);
+        text_rowid_.push_back(rec.text_rowid);
+        path_idx_.push_back(path_idx);
+        source_idx_.push_back(source_idx);
+        start_line_.push_back(rec.start_line);
+        end_line_.push_back(rec.end_line);
+        timestamp_.push_back(rec.timestamp);
+        deleted_.push_back(0);
+    }
+
+    static uint32_t intern(std::unordered_map<std::string, uint32_t>& ids, std::vector<std::string>& values, const std::string& v) {
+        auto it = ids.find(v);
+        if (it != ids.end()) return it->second;
+        uint32_t idx = (uint32_t)values.size();
+        values.push_back(v);
+        ids.emplace(v, idx);
+        return idx;
+    }
+
+    std::string_view blob_view(uint64_t off, uint32_t len) const {
+        if (off + len > blob_.size()) return {};
+        return std::string_view(reinterpret_cast<const char*>(blob_.data()) + off, len);
+    }
+
+    fs::path meta_path_;
+    fs::path blob_path_;
+    fs::path del_path_;
+    std::ofstream meta_out_;
+    std::ofstream blob_out_;
+    std::ofstream del_out_;
+    MappedFile blob_;
+    uint64_t blob_size_ = 0;
+
+    // Columns, one entry per Faiss row
+    std::vector<uint64_t> blob_off_;
+    std::vector<uint64_t> key_;
+    std::vector<uint32_t> id_len_;
+    std::vector<uint32_t> text_len_;
+    std::vector<int64_t> text_rowid_;
+    std::vector<uint32_t> path_idx_;
+    std::vector<uint32_t> source_idx_;
+    std::vector<int32_t> start_line_;
+    std::vector<int32_t> end_line_;
+    std::vector<int64_t> timestamp_;
+    std::vector<uint8_t> deleted_;
+    size_t deleted_count_ = 0;
+
+    // Paths and sources repeat heavily, so rows store dictionary indexes.
+    std::vector<std::string> paths_;
+    std::vector<std::string> sources_;
+    std::unordered_map<std::string, uint32_t> path_ids_;
+    std::unordered_map<std::string, uint32_t> source_ids_;
+    std::vector<std::vector<size_t>> path_rows_; // path index -> its rows, ascending, until removed
+};
@@ -0,0 +1,99 @@
+#pragma once
+// RankFusion — reciprocal rank fusion over integer document keys.
+//
+// Every ranked list contributes weight / (k + rank + 1) to each document it
+// contains. Documents are identified by a 64-bit key (doc_key of the string
+// id), accumulated in an open-addressing table that is cleared rather than
+// freed between searches, so a reused instance stops allocating once warm.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// FNV-1a; stable across runs so it can also be persisted.
+inline uint64_t doc_key(std::string_view id) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : id) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+class RankFusion {
+public:
+    struct Entry {
+        uint64_t key;
+        float score;
+        uint32_t lists;   // bit per list that has contributed
+        int64_t row;      // vector row, -1 if the document only matched by keyword
+        int32_t keyword;  // index into the caller's keyword hits, -1 if none
+    };
+
+    // Start a new fusion expecting about `expected` distinct documents.
+    void reset(int k, size_t expected) {
+        k_ = k;
+        size_t cap = 16;
+        while (cap < expected * 2) cap <<= 1;
+        if (slots_.size() < cap) slots_.resize(cap);
+        mask_ = slots_.size() - 1;
+        std::fill(slots_.begin(), slots_.end(), 0u);
+        entries_.clear();
+    }
+
+    // Credit `key` with its rank in list `list` (0-31). Only the first, best
+    // ranked appearance in each list counts.
+    Entry& add(uint64_t key, uint32_t list, int rank, float weight) {
+        size_t i = (size_t)(key ^ (key >> 29)) & mask_;
+        while (uint32_t slot = slots_[i]) {
+            Entry& e = entries_[slot - 1];
+            if (e.key == key) {
+                uint32_t bit = 1u << list;
+                if (!(e.lists & bit)) {
+                    e.lists |= bit;
+                    e.score += weight / (float)(k_ + rank + 1);
+                }
+                return e;
+            }
+            i = (i + 1) & mask_;
+        }
+        if ((entries_.size() + 1) * 2 > slots_.size()) {
+            grow();
+            return add(key, list, rank, weight);
+        }
+        entries_.push_back({key, weight / (float)(k_ + rank + 1), 1u << list, -1, -1});
+        slots_[i] = (uint32_t)entries_.size();
+        return entries_.back();
+    }
+
+    std::vector<Entry>& entries() { return entries_; }
+
+    // Move the best n entries to the front in rank order (score, then key,
+    // so equal scores rank the same way every time) and drop the rest.
+    void select_top(size_t n) {
+        auto better = [](const Entry& a, const Entry& b) {
+            return a.score != b.score ? a.score > b.score : a.key < b.key;
+        };
+        n = std::min(n, entries_.size());
+        std::partial_sort(entries_.begin(), entries_.begin() + n, entries_.end(), better);
+        entries_.resize(n);
+    }
+
+private:
+    void grow() {
+        slots_.assign(slots_.size() * 2, 0u);
+        mask_ = slots_.size() - 1;
+        for (size_t e = 0; e < entries_.size(); ++e) {
+            size_t i = (size_t)(entries_[e].key ^ (entries_[e].key >> 29)) & mask_;
+            while (slots_[i]) i = (i + 1) & mask_;
+            slots_[i] = (uint32_t)(e + 1);
+        }
+    }
+
+    int k_ = 60;
+    size_t mask_ = 0;
+    std::vector<uint32_t> slots_; // entry index + 1; 0 marks an empty slot
+    std::vector<Entry> entries_;
+};
@@ -0,0 +1,153 @@
+#pragma once
+// SearchCache — recent MemoryIndex results, and the searches now running.
+//
+// Entries are stamped with the index generation they were computed at. Every
+// write bumps the generation, so an older entry is simply a miss: writers
+// never look for what they invalidated. Identical searches that arrive while
+// one is running join it (singleflight) instead of running again.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "memory_index.hpp"
+#include "rank_fusion.hpp"
+
+class SearchCache {
+public:
+    // One running search; followers are woken when the leader finishes it.
+    struct Flight {
+        std::vector<SearchResult> results;
+        bool done = false;
+        std::vector<std::function<void()>> waiters;
+    };
+
+    explicit SearchCache(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+    // Key for a search. Runs of whitespace in the query collapse to one
+    // space; case is kept, since it changes both the keyword query (FTS5 and
+    // Lucene operators are upper case) and the embedding. A null `embedding`
+    // means the embedding is derived from the query text.
+    static std::string key(const std::string& query, const std::vector<float>* embedding, int top_k,
+                           const SearchFilter& filter) {
+        std::string k;
+        bool space = false;
+        for (unsigned char c : query) {
+            if (std::isspace(c)) {
+                space = !k.empty();
+                continue;
+            }
+            if (space) k += ' ';
+            space = false;
+            k += (char)c;
+        }
+        auto field = [&](std::string_view v) {
+            k += '\x1f';
+            k += std::to_string(v.size());
+            k += ':';
+            k.append(v);
+        };
+        if (embedding) {
+            std::string_view bytes(reinterpret_cast<const char*>(embedding->data()), embedding->size() * sizeof(float));
+            field(std::to_string(doc_key(bytes)));
+        } else {
+            field("q");
+        }
+        field(std::to_string(top_k));
+        std::vector<std::string> sources = filter.sources;
+        std::sort(sources.begin(), sources.end());
+        for (const auto& s : sources) field(s);
+        field(filter.session);
+        field(filter.path_prefix);
+        field(std::to_string(filter.since) + "-" + std::to_string(filter.until));
+        return k;
+    }
+
+    bool get(const std::string& key, uint64_t generation, std::vector<SearchResult>& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) return false;
+        if (it->second->generation != generation) {
+            lru_.erase(it->second);
+            index_.erase(it);
+            return false;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        out = it->second->results;
+        return true;
+    }
+
+    // Join the search for `key` already running at `generation`, or start
+    // one. The second member is true if the caller leads (and must finish) it.
+    std::pair<std::shared_ptr<Flight>, bool> join(const std::string& key, uint64_t generation) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& flight = flights_[{key, generation}];
+        if (flight) return {flight, false};
+        flight = std::make_shared<Flight>();
+        return {flight, true};
+    }
+
+    // Publish the leader's results to its followers and, if `cacheable`, to
+    // later lookups at the same generation.
+    void finish(const std::string& key, uint64_t generation, const std::shared_ptr<Flight>& flight,
+                const std::vector<SearchResult>& results, bool cacheable) {
+        std::vector<std::function<void()>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flights_.erase({key, generation});
+            flight->results = results;
+            flight->done = true;
+            waiters.swap(flight->waiters);
+            if (cacheable) put_locked(key, generation, results);
+        }
+        for (auto& wake : waiters) wake();
+    }
+
+    // Call `wake` once `flight` is done (at once if it already is).
+    void wait(const std::shared_ptr<Flight>& flight, std::function<void()> wake) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!flight->done) {
+                flight->waiters.push_back(std::move(wake));
+                return;
+            }
+        }
+        wake();
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<SearchResult> results;
+    };
+
+    void put_locked(const std::string& key, uint64_t generation, const std::vector<SearchResult>& results) {
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            lru_.erase(it->second);
+            index_.erase(it);
+        }
+        lru_.push_front({key, generation, results});
+        index_[key] = lru_.begin();
+        if (lru_.size() > capacity_) {
+            index_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+    }
+
+    size_t capacity_;
+    std::mutex mutex_;
+    std::list<Entry> lru_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::map<std::pair<std::string, uint64_t>, std::shared_ptr<Flight>> flights_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+// ShardIndex — groups vector rows by (calendar month, source) so a decayed
+// search can visit the partitions that might still score well and skip the
+// rest. Each shard records its newest timestamp and largest vector norm;
+// with the source's weight and decay rate those bound what any of its rows
+// can score, so once the current top-k beats a shard's bound the shard and
+// every shard with a lower bound can be skipped unread.
+//
+// Shards are a view over row numbers; the rows themselves stay in the one
+// flat index, so adds, tombstones and compaction are unchanged.
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class ShardIndex {
+public:
+    static constexpr int32_t kUndated = -1;
+
+    struct Shard {
+        int32_t month;       // months since 1970-01, or kUndated
+        uint32_t source;     // MetaStore source index
+        int64_t newest = 0;  // newest timestamp among its rows
+        float max_norm = 0;  // largest L2 norm among its vectors
+        std::vector<int64_t> rows; // ascending
+    };
+
+    void clear() {
+        shards_.clear();
+        lookup_.clear();
+    }
+
+    // Rows must be added in increasing order.
+    void add(int64_t row, uint32_t source, int64_t timestamp, float norm) {
+        int32_t month = timestamp > 0 ? month_of(timestamp) : kUndated;
+        uint64_t key = ((uint64_t)(uint32_t)month << 32) | source;
+        auto [it, inserted] = lookup_.try_emplace(key, (uint32_t)shards_.size());
+        if (inserted) shards_.push_back({month, source, 0, 0.0f, {}});
+        Shard& s = shards_[it->second];
+        s.newest = std::max(s.newest, timestamp);
+        s.max_norm = std::max(s.max_norm, norm);
+        s.rows.push_back(row);
+    }
+
+    const std::vector<Shard>& shards() const { return shards_; }
+    size_t size() const { return shards_.size(); }
+
+    // Months since 1970-01 of an epoch-seconds UTC timestamp.
+    static int32_t month_of(int64_t timestamp) {
+        // Civil-from-days, proleptic Gregorian.
+        int64_t z = timestamp / 86400 + 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        int64_t doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        int64_t month = mp < 10 ? mp + 3 : mp - 9;
+        int64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+        return (int32_t)((year - 1970) * 12 + (month - 1));
+    }
+
+private:
+    std::vector<Shard> shards_;
+    std::unordered_map<uint64_t, uint32_t> lookup_; // (month, source) -> shard
+};
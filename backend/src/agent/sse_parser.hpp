@@ -0,0 +1,146 @@
+#pragma once
+// SseParser — incremental framing of a text/event-stream response body.
+//
+// feed() takes each chunk as curl delivers it and hands every complete
+// event to the callback as (type, data). Line ends are found with memchr,
+// which libc vectorizes, and consumed bytes are dropped only once they
+// outnumber the bytes still needed, so framing costs time linear in the
+// stream. The buffer always extends SIMDJSON_PADDING bytes past its contents:
+// the data of a one-line event is passed as a view into it, ready for simdjson
+// to parse in place, and only multi-line data is joined into scratch space.
+//
+// Per the SSE spec, lines end in LF, CRLF or CR and a blank line ends an
+// event. "data:" lines are joined with LF, "event:" sets the type (default
+// "message"), and one space after the colon is dropped. Comments (":") and
+// other fields are ignored. finish() also dispatches a last event whose
+// closing blank line never came.
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <simdjson.h>
+
+class SseParser {
+public:
+    // `data` is readable for SIMDJSON_PADDING bytes past its end, and valid
+    // until the callback returns.
+    using EventFn = std::function<void(std::string_view type, std::string_view data)>;
+
+    explicit SseParser(EventFn on_event) : on_event_(std::move(on_event)) {}
+
+    void feed(const char* p, size_t n) {
+        reserve(n);
+        std::memcpy(buf_.data() + end_, p, n);
+        end_ += n;
+        scan(false);
+    }
+
+    // End of stream: the last line needs no terminator.
+    void finish() {
+        scan(true);
+        dispatch();
+    }
+
+private:
+    // Room for `n` more bytes plus padding, first dropping what no pending
+    // line or event still refers to.
+    void reserve(size_t n) {
+        size_t keep = data_.empty() ? scan_ : std::min(scan_, data_.front().first);
+        if (keep > 0 && keep >= end_ - keep) {
+            std::memmove(buf_.data(), buf_.data() + keep, end_ - keep);
+            end_ -= keep;
+            scan_ -= keep;
+            for (auto& d : data_) d.first -= keep;
+        }
+        size_t need = end_ + n + simdjson::SIMDJSON_PADDING;
+        if (buf_.size() < need) buf_.resize(std::max(need, buf_.size() * 2));
+    }
+
+    void scan(bool eof) {
+        while (scan_ < end_) {
+            const char* line = buf_.data() + scan_;
+            size_t avail = end_ - scan_;
+            const char* lf = (const char*)std::memchr(line, '\n', avail);
+            size_t limit = lf ? (size_t)(lf - line) : avail;
+            const char* cr = (const char*)std::memchr(line, '\r', limit);
+            size_t len, next;
+            if (cr) {
+                len = (size_t)(cr - line);
+                if (len + 1 < avail) {
+                    next = len + 1 + (cr[1] == '\n');
+                } else if (eof) {
+                    next = len + 1;
+                } else {
+                    break; // its LF may be in the next chunk
+                }
+            } else if (lf) {
+                len = limit;
+                next = len + 1;
+            } else if (eof) {
+                len = next = avail;
+            } else {
+                break;
+            }
+            size_t at = scan_;
+            scan_ += next;
+            on_line(at, len);
+        }
+    }
+
+    void on_line(size_t at, size_t len) {
+        if (len == 0) {
+            dispatch();
+            return;
+        }
+        const char* s = buf_.data() + at;
+        if (s[0] == ':') return;
+        const char* colon = (const char*)std::memchr(s, ':', len);
+        size_t name_len = colon ? (size_t)(colon - s) : len;
+        size_t value = colon ? name_len + 1 : len;
+        if (value < len && s[value] == ' ') ++value;
+
+        std::string_view name(s, name_len);
+        if (name == "data") {
+            data_.emplace_back(at + value, len - value);
+        } else if (name == "event") {
+            type_.assign(s + value, len - value);
+        }
+    }
+
+    void dispatch() {
+        if (data_.empty()) {
+            type_.clear();
+            return;
+        }
+        std::string_view data;
+        if (data_.size() == 1) {
+            data = std::string_view(buf_.data() + data_[0].first, data_[0].second);
+        } else {
+            size_t total = data_.size() - 1;
+            for (const auto& d : data_) total += d.second;
+            joined_.resize(total + simdjson::SIMDJSON_PADDING);
+            char* out = joined_.data();
+            for (size_t i = 0; i < data_.size(); ++i) {
+                if (i > 0) *out++ = '\n';
+                std::memcpy(out, buf_.data() + data_[i].first, data_[i].second);
+                out += data_[i].second;
+            }
+            data = std::string_view(joined_.data(), total);
+        }
+        on_event_(type_.empty() ? std::string_view("message") : std::string_view(type_), data);
+        data_.clear();
+        type_.clear();
+    }
+
+    EventFn on_event_;
+    std::vector<char> buf_;
+    size_t scan_ = 0; // start of the first line not yet read
+    size_t end_ = 0;  // end of the bytes fed so far
+    std::vector<std::pair<size_t, size_t>> data_; // offset and length of each data line of the pending event
+    std::string type_;
+    std::vector<char> joined_;
+};
@@ -0,0 +1,301 @@
+#pragma once
+// StaticEmbedder — in-process embeddings from a static token-embedding table,
+// as distilled by model2vec: a directory holding model.safetensors (one
+// [vocab x dim] tensor, F32 or F16) and the tokenizer.json it was made with.
+//
+// A text is split into WordPiece tokens, their rows are summed straight out
+// of the memory-mapped table with faiss's vector kernels, and the sum is
+// L2-normalized (the mean, up to scale). Tokens the vocabulary lacks are
+// dropped. An embedding costs microseconds and no network, at lower quality
+// than a transformer model. Immutable after load(), so nodes share one.
+
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <faiss/utils/distances.h>
+#include <simdjson.h>
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.hpp"
+
+namespace fs = std::filesystem;
+
+class StaticEmbedder {
+public:
+    // Load the model in `dir`, keeping the first `dim` dimensions of each
+    // vector (model2vec tables are PCA-ordered, so truncation is safe).
+    bool load(const fs::path& dir, int dim) {
+        if (!load_table(dir / "model.safetensors") || !load_tokenizer(dir / "tokenizer.json")) return false;
+        if (dim <= 0 || (size_t)dim > cols_) {
+            spdlog::error("Static embedding model {} has {} dimensions; embedding.dimension is {}",
+                          dir.string(), cols_, dim);
+            return false;
+        }
+        dim_ = (size_t)dim;
+        spdlog::info("Static embedding model {}: {} tokens x {} dimensions (using {})",
+                     dir.string(), rows_, cols_, dim_);
+        return true;
+    }
+
+    bool loaded() const { return dim_ > 0; }
+
+    // Empty when nothing is loaded or no token of `text` is in the vocabulary.
+    std::vector<float> embed(std::string_view text) const {
+        if (!loaded()) return {};
+        std::vector<int> ids = tokenize(text);
+        if (ids.empty()) return {};
+
+        std::vector<float> sum(dim_, 0.0f);
+        std::vector<float> row(f16_ || !aligned_ ? dim_ : 0);
+        for (int id : ids) {
+            const uint8_t* src = table_ + (size_t)id * cols_ * elem_bytes();
+            const float* r;
+            if (f16_) {
+                const auto* h = reinterpret_cast<const uint16_t*>(src);
+                for (size_t i = 0; i < dim_; ++i) row[i] = half_to_float(h[i]);
+                r = row.data();
+            } else if (!aligned_) {
+                std::memcpy(row.data(), src, dim_ * sizeof(float));
+                r = row.data();
+            } else {
+                r = reinterpret_cast<const float*>(src);
+            }
+            faiss::fvec_madd(dim_, sum.data(), 1.0f, r, sum.data());
+        }
+
+        float norm = std::sqrt(faiss::fvec_norm_L2sqr(sum.data(), dim_));
+        if (norm > 0.0f) {
+            float inv = 1.0f / norm;
+            for (float& v : sum) v *= inv;
+        }
+        return sum;
+    }
+
+    // BERT-style pre-tokenization (whitespace, then ASCII punctuation as
+    // tokens of its own, ASCII lowercased when the tokenizer asks for it),
+    // then greedy longest-match WordPiece within each word.
+    std::vector<int> tokenize(std::string_view text) const {
+        std::vector<int> ids;
+        std::string word;
+        auto flush = [&]() {
+            if (!word.empty()) wordpiece(word, ids);
+            word.clear();
+        };
+        for (char c : text) {
+            unsigned char u = (unsigned char)c;
+            if (u < 0x80 && std::isspace(u)) {
+                flush();
+            } else if (u < 0x80 && std::ispunct(u)) {
+                flush();
+                word.push_back(c);
+                flush();
+            } else {
+                word.push_back(lowercase_ && u < 0x80 ? (char)std::tolower(u) : c);
+            }
+        }
+        flush();
+        return ids;
+    }
+
+private:
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    size_t elem_bytes() const { return f16_ ? 2 : 4; }
+
+    // A word none of whose splits is in the vocabulary adds nothing, as if
+    // it were the unknown token, which model2vec drops.
+    void wordpiece(std::string_view word, std::vector<int>& ids) const {
+        if (word.size() > max_word_chars_) return;
+        size_t mark = ids.size();
+        std::string piece;
+        size_t start = 0;
+        while (start < word.size()) {
+            size_t end = word.size();
+            int id = -1;
+            while (end > start) {
+                piece.assign(start > 0 ? prefix_ : std::string());
+                piece.append(word.substr(start, end - start));
+                auto it = vocab_.find(std::string_view(piece));
+                if (it != vocab_.end()) {
+                    id = it->second;
+                    break;
+                }
+                do {
+                    --end;
+                } while (end > start && ((unsigned char)word[end] & 0xC0) == 0x80); // UTF-8 boundary
+            }
+            if (id < 0) {
+                ids.resize(mark);
+                return;
+            }
+            if (id != unk_id_) ids.push_back(id);
+            start = end;
+        }
+    }
+
+    static float half_to_float(uint16_t h) {
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t exp = (h >> 10) & 0x1f;
+        uint32_t mant = h & 0x3ff;
+        uint32_t bits;
+        if (exp == 0x1f) {
+            bits = sign | 0x7f800000 | (mant << 13);
+        } else if (exp != 0) {
+            bits = sign | ((exp + 112) << 23) | (mant << 13);
+        } else if (mant == 0) {
+            bits = sign;
+        } else { // subnormal
+            exp = 113;
+            while (!(mant & 0x400)) {
+                mant <<= 1;
+                --exp;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // safetensors: an 8-byte little-endian header length, a JSON header of
+    // name -> {dtype, shape, data_offsets}, then the raw tensor bytes.
+    bool load_table(const fs::path& path) {
+        if (!map_.open(path) || map_.size() < 8) {
+            spdlog::error("Static embedding model {} not found", path.string());
+            return false;
+        }
+        uint64_t header_len = 0;
+        for (int i = 7; i >= 0; --i) header_len = (header_len << 8) | map_.data()[i];
+        if (header_len > map_.size() - 8) {
+            spdlog::error("Static embedding model {} is truncated", path.string());
+            return false;
+        }
+
+        simdjson::dom::parser parser;
+        simdjson::dom::object header;
+        simdjson::padded_string json(reinterpret_cast<const char*>(map_.data()) + 8, (size_t)header_len);
+        if (parser.parse(json).get(header)) {
+            spdlog::error("Static embedding model {} has an unreadable header", path.string());
+            return false;
+        }
+        // model2vec names the table "embeddings"; otherwise take the first matrix.
+        simdjson::dom::object tensor;
+        bool found = false;
+        for (auto field : header) {
+            simdjson::dom::object t;
+            simdjson::dom::array shape;
+            if (field.key == "__metadata__" || field.value.get(t) || t["shape"].get(shape) || shape.size() != 2) continue;
+            if (field.key == "embeddings" || !found) tensor = t;
+            found = true;
+            if (field.key == "embeddings") break;
+        }
+        std::string_view dtype;
+        simdjson::dom::array shape, offsets;
+        if (!found || tensor["dtype"].get(dtype) || tensor["shape"].get(shape) ||
+            tensor["data_offsets"].get(offsets) || offsets.size() != 2) {
+            spdlog::error("Static embedding model {} has no embedding matrix", path.string());
+            return false;
+        }
+        if (dtype != "F32" && dtype != "F16") {
+            spdlog::error("Static embedding model {} is {}; F32 or F16 is supported", path.string(), dtype);
+            return false;
+        }
+        f16_ = dtype == "F16";
+
+        uint64_t rows = 0, cols = 0, begin = 0, end = 0;
+        if (shape.at(0).get(rows) || shape.at(1).get(cols) || offsets.at(0).get(begin) || offsets.at(1).get(end) ||
+            end < begin || end - begin != rows * cols * elem_bytes() || 8 + header_len + end > map_.size()) {
+            spdlog::error("Static embedding model {} has an inconsistent embedding matrix", path.string());
+            return false;
+        }
+        rows_ = (size_t)rows;
+        cols_ = (size_t)cols;
+        table_ = map_.data() + 8 + header_len + begin;
+        aligned_ = reinterpret_cast<uintptr_t>(table_) % alignof(float) == 0;
+        return true;
+    }
+
+    bool load_tokenizer(const fs::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            spdlog::error("Static embedding tokenizer {} not found", path.string());
+            return false;
+        }
+        std::stringstream ss;
+        ss << in.rdbuf();
+
+        simdjson::dom::parser parser;
+        simdjson::dom::element doc;
+        simdjson::padded_string json(ss.str());
+        simdjson::dom::object model, vocab;
+        std::string_view type;
+        if (parser.parse(json).get(doc) || doc["model"].get(model) || model["type"].get(type) ||
+            model["vocab"].get(vocab)) {
+            spdlog::error("Static embedding tokenizer {} is unreadable", path.string());
+            return false;
+        }
+        if (type != "WordPiece") {
+            spdlog::error("Static embedding tokenizer {} is {}; WordPiece is supported", path.string(), type);
+            return false;
+        }
+
+        vocab_.clear();
+        vocab_.reserve(vocab.size());
+        for (auto field : vocab) {
+            int64_t id;
+            if (field.value.get(id) || id < 0 || (size_t)id >= rows_) continue;
+            vocab_.emplace(std::string(field.key), (int)id);
+        }
+        std::string_view unk, prefix;
+        if (!model["unk_token"].get(unk)) {
+            auto it = vocab_.find(unk);
+            unk_id_ = it == vocab_.end() ? -1 : it->second;
+        }
+        if (!model["continuing_subword_prefix"].get(prefix)) prefix_ = std::string(prefix);
+        uint64_t max_chars;
+        if (!model["max_input_chars_per_word"].get(max_chars)) max_word_chars_ = (size_t)max_chars;
+
+        // BertNormalizer carries a lowercase flag; a Sequence may hold a Lowercase step.
+        lowercase_ = false;
+        simdjson::dom::object normalizer;
+        if (!doc["normalizer"].get(normalizer)) {
+            bool flag = false;
+            std::string_view ntype;
+            simdjson::dom::array steps;
+            if (!normalizer["lowercase"].get(flag)) lowercase_ = flag;
+            if (!normalizer["type"].get(ntype) && ntype == "Lowercase") lowercase_ = true;
+            if (!normalizer["normalizers"].get(steps)) {
+                for (auto step : steps) {
+                    if (!step["type"].get(ntype) && ntype == "Lowercase") lowercase_ = true;
+                    if (!step["lowercase"].get(flag) && flag) lowercase_ = true;
+                }
+            }
+        }
+        return !vocab_.empty();
+    }
+
+    MappedFile map_;
+    const uint8_t* table_ = nullptr;
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+    size_t dim_ = 0; // leading columns used; 0 until loaded
+    bool f16_ = false;
+    bool aligned_ = true;
+
+    std::unordered_map<std::string, int, StringHash, std::equal_to<>> vocab_;
+    int unk_id_ = -1;
+    std::string prefix_ = "##";
+    size_t max_word_chars_ = 100;
+    bool lowercase_ = true;
+};
@@ -0,0 +1,129 @@
+#pragma once
+// VectorFile — row-aligned full-precision embeddings (vectors.f32). Rows are
+// appended as raw floats after a small header and read back through a memory
+// mapping, so only the rows a search touches are ever paged in, and the pages
+// are shared by every process that maps the file. With fp32 storage it is the
+// flat index itself (MappedFlatIndex); with quantized storage it backs the
+// exact re-ranking of the shortlist.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <spdlog/spdlog.h>
+
+#include "mapped_file.hpp"
+
+namespace fs = std::filesystem;
+
+class VectorFile {
+public:
+    VectorFile(const fs::path& path, int dim) : path_(path), dim_(dim) {
+        std::error_code ec;
+        uint64_t bytes = check_header(fs::exists(path_, ec) ? fs::file_size(path_, ec) : 0);
+        rows_ = (bytes - kHeaderBytes) / row_bytes();
+        if (kHeaderBytes + rows_ * row_bytes() != bytes) fs::resize_file(path_, kHeaderBytes + rows_ * row_bytes(), ec); // torn tail
+        map_.open(path_);
+        out_.open(path_, std::ios::binary | std::ios::app);
+        if (!out_.is_open()) spdlog::warn("Failed to open vector file {}", path_.string());
+    }
+
+    int dim() const { return dim_; }
+
+    // Dimension recorded in the header of the file at `path`; 0 if it has none.
+    static int stored_dim(const fs::path& path) {
+        uint32_t head[3] = {0, 0, 0};
+        std::ifstream in(path, std::ios::binary);
+        if (!in.read(reinterpret_cast<char*>(head), sizeof(head)) || head[0] != kMagic || head[1] != kVersion) return 0;
+        return (int)head[2];
+    }
+    size_t size() const { return rows_; }
+
+    void append(const float* v, size_t n = 1) {
+        out_.write(reinterpret_cast<const char*>(v), n * row_bytes());
+        rows_ += n;
+    }
+
+    // Make appended rows readable; called once per worker batch.
+    void flush() {
+        out_.flush();
+        if (map_.size() < kHeaderBytes + rows_ * row_bytes()) map_.grow();
+    }
+
+    // Rows that can be read through the mapping.
+    size_t readable() const {
+        return map_.size() > kHeaderBytes ? std::min<size_t>(rows_, (map_.size() - kHeaderBytes) / row_bytes()) : 0;
+    }
+
+    // nullptr if the row has not been flushed.
+    const float* row(size_t r) const {
+        if (r >= readable()) return nullptr;
+        return reinterpret_cast<const float*>(map_.data() + kHeaderBytes) + r * dim_;
+    }
+
+    void truncate(size_t rows) {
+        if (rows >= rows_) return;
+        out_.close();
+        map_.close();
+        std::error_code ec;
+        fs::resize_file(path_, kHeaderBytes + rows * row_bytes(), ec);
+        rows_ = rows;
+        map_.open(path_);
+        out_.open(path_, std::ios::binary | std::ios::app);
+    }
+
+    void reset() { truncate(0); }
+
+    void close() {
+        out_.close();
+        map_.close();
+    }
+
+private:
+    // 64 bytes keeps every row as aligned as the mapping itself.
+    static constexpr uint64_t kHeaderBytes = 64;
+    static constexpr uint32_t kMagic = 0x32334656; // "VF32"
+    static constexpr uint32_t kVersion = 1;
+
+    uint64_t row_bytes() const { return (uint64_t)dim_ * sizeof(float); }
+
+    // Validate the header, starting the file afresh if it is new, was made
+    // for another dimension, or has no valid header. Returns the file size.
+    uint64_t check_header(uint64_t bytes) {
+        uint32_t head[3] = {0, 0, 0};
+        if (bytes >= kHeaderBytes) {
+            std::ifstream in(path_, std::ios::binary);
+            in.read(reinterpret_cast<char*>(head), sizeof(head));
+        }
+        if (head[0] == kMagic && head[1] == kVersion) {
+            if (head[2] == (uint32_t)dim_) return bytes;
+            spdlog::warn("Vector file {} has dimension {}, expected {}. Resetting it.", path_.string(), head[2], dim_);
+        } else if (bytes > 0) {
+            spdlog::warn("Vector file {} has no valid header. Resetting it.", path_.string());
+        }
+        return write_header();
+    }
+
+    uint64_t write_header() {
+        char header[kHeaderBytes] = {};
+        uint32_t fields[3] = {kMagic, kVersion, (uint32_t)dim_};
+        std::memcpy(header, fields, sizeof(fields));
+        fs::path tmp = path_;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            out.write(header, sizeof(header));
+        }
+        std::error_code ec;
+        fs::rename(tmp, path_, ec);
+        return kHeaderBytes;
+    }
+
+    fs::path path_;
+    int dim_;
+    size_t rows_ = 0;
+    std::ofstream out_;
+    MappedFile map_;
+};
@@ -0,0 +1,120 @@
+#pragma once
+// VectorWal — append-only log of (row, id, embedding) records for MemoryIndex.
+// Under quantized storage each add is appended here instead of rewriting
+// faiss.index; a checkpoint rewrites the index and starts a fresh log. (fp32
+// rows are durable in vectors.f32 itself and are not logged.) On startup the log is replayed
+// on top of the last checkpoint. Records carry their Faiss row so replaying
+// a log that the checkpoint already covers is a no-op.
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+class VectorWal {
+public:
+    using ReplayFn = std::function<void(uint64_t row, const std::string& id, const std::vector<float>& embedding)>;
+
+    explicit VectorWal(const fs::path& path) : path_(path) {}
+
+    ~VectorWal() { close(); }
+
+    const fs::path& path() const { return path_; }
+
+    void open() {
+        out_.open(path_, std::ios::binary | std::ios::app);
+        std::error_code ec;
+        bytes_ = fs::exists(path_, ec) ? fs::file_size(path_, ec) : 0;
+        if (!out_.is_open()) spdlog::warn("Failed to open vector WAL {}", path_.string());
+    }
+
+    void close() {
+        if (out_.is_open()) out_.close();
+    }
+
+    void append(uint64_t row, const std::string& id, const float* embedding, uint32_t dim) {
+        if (!out_.is_open()) return;
+        uint32_t id_len = (uint32_t)id.size();
+        out_.write(reinterpret_cast<const char*>(&kMagic), sizeof(kMagic));
+        out_.write(reinterpret_cast<const char*>(&row), sizeof(row));
+        out_.write(reinterpret_cast<const char*>(&id_len), sizeof(id_len));
+        out_.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+        out_.write(id.data(), id_len);
+        out_.write(reinterpret_cast<const char*>(embedding), sizeof(float) * dim);
+        bytes_ += sizeof(kMagic) + sizeof(row) + sizeof(id_len) + sizeof(dim) + id_len + sizeof(float) * dim;
+        ++records_;
+    }
+
+    // Push buffered records to the OS; called once per worker batch.
+    void flush() {
+        if (out_.is_open()) out_.flush();
+    }
+
+    uint64_t bytes() const { return bytes_; }
+    uint64_t records() const { return records_; }
+
+    // Close the current log and move it aside so a checkpoint can consume it
+    // while new records go to a fresh file.
+    bool rotate_to(const fs::path& sealed) {
+        close();
+        std::error_code ec;
+        fs::rename(path_, sealed, ec);
+        bytes_ = 0;
+        records_ = 0;
+        open();
+        return !ec;
+    }
+
+    void reset() {
+        close();
+        std::error_code ec;
+        fs::remove(path_, ec);
+        bytes_ = 0;
+        records_ = 0;
+        open();
+    }
+
+    // Replays every complete record; a torn tail from a crash mid-append is ignored.
+    static size_t replay(const fs::path& path, const ReplayFn& fn) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return 0;
+
+        size_t count = 0;
+        std::string id;
+        std::vector<float> embedding;
+        while (true) {
+            uint32_t magic = 0, id_len = 0, dim = 0;
+            uint64_t row = 0;
+            if (!in.read(reinterpret_cast<char*>(&magic), sizeof(magic))) break;
+            if (magic != kMagic) {
+                spdlog::warn("Corrupt record in vector WAL {} after {} records", path.string(), count);
+                break;
+            }
+            if (!in.read(reinterpret_cast<char*>(&row), sizeof(row))) break;
+            if (!in.read(reinterpret_cast<char*>(&id_len), sizeof(id_len))) break;
+            if (!in.read(reinterpret_cast<char*>(&dim), sizeof(dim))) break;
+            if (id_len > (1u << 20) || dim > (1u << 16)) break;
+            id.resize(id_len);
+            embedding.resize(dim);
+            if (!in.read(id.data(), id_len)) break;
+            if (!in.read(reinterpret_cast<char*>(embedding.data()), sizeof(float) * dim)) break;
+            fn(row, id, embedding);
+            ++count;
+        }
+        return count;
+    }
+
+private:
+    static constexpr uint32_t kMagic = 0x4c415756; // "VWAL"
+
+    fs::path path_;
+    std::ofstream out_;
+    uint64_t bytes_ = 0;
+    uint64_t records_ = 0;
+};
@@ -2,6 +2,7 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <spdlog/spdlog.h>
@@ -189,6 +190,22 @@ public:
   float memory_compaction_threshold() const {
     return get("memory", "compaction_threshold", 0.8f);
   }
+  // Per-source overrides of the search decay half-life, in days.
+  std::map<std::string, double> memory_decay_half_life_days() const {
+    return get<std::map<std::string, double>>("memory", "decay_half_life_days", {});
+  }
+  // index_document chunk size and overlap, in characters of whole lines.
+  int memory_chunk_chars() const { return get("memory", "chunk_chars", 1600); }
+  int memory_chunk_overlap_chars() const {
+    return get("memory", "chunk_overlap_chars", 320);
+  }
+  // Write-behind session indexing: queue capacity, and messages per batch.
+  int memory_index_queue_capacity() const {
+    return get("memory", "index_queue_capacity", 1024);
+  }
+  int memory_index_batch_size() const {
+    return get("memory", "index_batch_size", 32);
+  }
   std::string memory_distillation_provider() const {
     return get<std::string>("memory", "provider", "openai");
   }
@@ -218,6 +235,95 @@ public:
   int embedding_dimension() const {
     return get<int>("embedding", "dimension", 1536);
   }
+  // "float" sends no encoding_format, which every server accepts; "base64"
+  // asks providers known to support it (OpenAI) for packed float32 vectors.
+  std::string embedding_encoding_format() const {
+    return get<std::string>("embedding", "encoding_format", "float");
+  }
+  // provider "static": a model2vec model directory (model.safetensors and
+  // tokenizer.json), relative to the workspace unless absolute.
+  std::string embedding_static_model() const {
+    return get<std::string>("embedding", "static_model", "models/potion-base-8M");
+  }
+  // Embedding requests one index_document call keeps in flight.
+  int embedding_max_in_flight() const {
+    return get("embedding", "max_in_flight", 4);
+  }
+  // Embedding calls made on one node within batch_window_ms of each other
+  // are sent as one request of up to batch_max texts.
+  int embedding_batch_max() const { return get("embedding", "batch_max", 64); }
+  int embedding_batch_window_ms() const {
+    return get("embedding", "batch_window_ms", 5);
+  }
+  // Embedding cache: vectors kept in memory, and the size of the on-disk
+  // store behind them (0 disables the cache).
+  int embedding_cache_entries() const {
+    return get("embedding", "cache_entries", 4096);
+  }
+  int embedding_cache_max_mb() const {
+    return get("embedding", "cache_max_mb", 256);
+  }
+  // Re-embedding after a model or dimension change: documents per batch, and
+  // documents per second at most (0 = unlimited).
+  int embedding_reembed_batch_size() const {
+    return get("embedding", "reembed_batch_size", 256);
+  }
+  double embedding_reembed_max_per_sec() const {
+    return get("embedding", "reembed_max_per_sec", 20.0);
+  }
+
+  // Vector index
+  std::string index_type() const {
+    return get<std::string>("index", "type", "flat");
+  }
+  int index_hnsw_m() const { return get("index", "hnsw_m", 32); }
+  int index_hnsw_ef_construction() const {
+    return get("index", "hnsw_ef_construction", 40);
+  }
+  int index_hnsw_ef_search() const { return get("index", "hnsw_ef_search", 64); }
+  int index_ivf_nlist() const { return get("index", "ivf_nlist", 1024); }
+  int index_ivf_nprobe() const { return get("index", "ivf_nprobe", 16); }
+  int index_pq_m() const { return get("index", "pq_m", 64); }
+  int index_pq_nbits() const { return get("index", "pq_nbits", 8); }
+  int index_ann_min_vectors() const {
+    return get("index", "ann_min_vectors", 20000);
+  }
+  int index_wal_checkpoint_mb() const {
+    return get("index", "wal_checkpoint_mb", 64);
+  }
+  int index_wal_checkpoint_interval_sec() const {
+    return get("index", "wal_checkpoint_interval_sec", 600);
+  }
+  int index_keyword_commit_interval_ms() const {
+    return get("index", "keyword_commit_interval_ms", 1000);
+  }
+  int index_search_threads() const { return get("index", "search_threads", 2); }
+  int index_shard_search_threads() const {
+    return get("index", "shard_search_threads", 2);
+  }
+  int index_search_cache_entries() const {
+    return get("index", "search_cache_entries", 256);
+  }
+  int index_rrf_k() const { return get("index", "rrf_k", 60); }
+  float index_vector_weight() const { return get("index", "vector_weight", 0.7f); }
+  float index_keyword_weight() const {
+    return get("index", "keyword_weight", 0.3f);
+  }
+  std::map<std::string, float> index_source_weights() const {
+    return get<std::map<std::string, float>>("index", "source_weights", {});
+  }
+  double index_compact_tombstone_ratio() const {
+    return get("index", "compact_tombstone_ratio", 0.25);
+  }
+  int index_compact_min_tombstones() const {
+    return get("index", "compact_min_tombstones", 32);
+  }
+  std::string index_vector_storage() const {
+    return get<std::string>("index", "vector_storage", "fp32");
+  }
+  int index_rerank_factor() const {
+    return get("index", "rerank_factor", 4);
+  }
 
   // Logging
   std::string logging_level() const {
@@ -172,6 +172,10 @@ int main() {
 
   init_spawn_system();
 
+  // Memory indexed under a previous embedding model is re-embedded in the
+  // background; searches fall back to keywords for it until then.
+  spawn_in_fiber([] { global_agent.reembed_memory(); });
+
   // Initialize and start CronService
   CronService::instance().init(Config::instance().memory_workspace());
   CronService::instance().start();
@@ -194,6 +198,7 @@ int main() {
   miniclaw_wait_for_shutdown();
 
   spdlog::info("Initiating graceful shutdown...");
+  global_agent.flush_memory(); // queued session messages, while the nodes can still embed them
   FiberPool::instance().stop(); // Stop the FiberPool
   CronService::instance().stop(); // Stop the CronService
   curl_global_cleanup(); // Cleanup libcurl
@@ -356,8 +356,7 @@ private:
     // SAFETY: Triggered by CurlMultiManager on the fiber's owning thread.
     data->callback = [data](CURLcode code) { fiber_resume(data->fiber); };
 
-    CURL *easy = curl_easy_init();
-    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    CURL *easy = CurlMultiManager::instance().acquire(url);
     curl_easy_setopt(easy, CURLOPT_PRIVATE, &data->callback);
     curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 0L);
     curl_easy_setopt(easy, CURLOPT_TIMEOUT, 30L);
@@ -399,7 +398,7 @@ private:
     CurlMultiManager::instance().remove_handle(easy);
     if (data->header_list)
       curl_slist_free_all(data->header_list);
-    curl_easy_cleanup(easy);
+    CurlMultiManager::instance().release(url, easy);
     delete data;
 
     return result;
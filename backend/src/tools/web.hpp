@@ -28,8 +28,7 @@ inline std::string curl_fetch(const std::string& url, const std::vector<std::str
         fiber_resume(data->fiber);
     };
 
-    CURL* easy = curl_easy_init();
-    curl_easy_setopt(easy, CURLOPT_URL, url.c_str());
+    CURL* easy = CurlMultiManager::instance().acquire(url);
     curl_easy_setopt(easy, CURLOPT_PRIVATE, &data->callback);
     curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(easy, CURLOPT_SSL_VERIFYPEER, 0L);
@@ -59,7 +58,7 @@ inline std::string curl_fetch(const std::string& url, const std::vector<std::str
 
     CurlMultiManager::instance().remove_handle(easy);
     if (data->header_list) curl_slist_free_all(data->header_list);
-    curl_easy_cleanup(easy);
+    CurlMultiManager::instance().release(url, easy);
     delete data;
 
     return result;
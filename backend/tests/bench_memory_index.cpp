@@ -0,0 +1,373 @@
+// bench_memory_index — MemoryIndex throughput, latency and recall on a
+// synthetic corpus.
+//
+//   bench_memory_index [--docs 10000,100000] [--dim 256] [--queries 1000]
+//                      [--recall-queries 200] [--k 10] [--threads 4] [--batch 256]
+//                      [--index-type flat] [--storage fp32] [--settle-sec 0]
+//                      [--dir bench_memory_db] [--seed 42] [--out result.json]
+//
+// Documents are clustered unit vectors (a topic centroid plus noise) with
+// text drawn from a Zipf vocabulary plus their topic's words, spread over two
+// years of dated paths and the three sources. Queries are perturbed copies
+// of random documents, so the exact top-k is known to be meaningful.
+//
+// For each corpus size it reports insert throughput, reopen time, and for
+// vector-only and hybrid searches the QPS (with --threads callers) and
+// p50/p90/p99 latency. Recall@k is measured on the vector-only results of
+// the first --recall-queries queries against a brute-force scan. The cache
+// and decay are off, so every query does the full work and the ranking is
+// plain similarity. The keyword backend is fixed at build time (USE_SQLITE);
+// compare the two by running a build of each. Results are written as one
+// JSON document.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "../src/agent/memory_index.hpp"
+#include "../src/agent/fiber_pool.hpp"
+#include "../src/json_util.hpp"
+#include <spdlog/spdlog.h>
+
+// The index only talks to fiber nodes when called from one.
+FiberNode* FiberNode::current() { return nullptr; }
+void FiberNode::spawn(std::function<void()> task) {}
+void FiberNode::spawn_back_on_loop(std::function<void()> task) {}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Options {
+    std::vector<size_t> docs = {10000};
+    int dim = 256;
+    int queries = 1000;
+    int recall_queries = 200;
+    int k = 10;
+    int threads = 4;
+    int batch = 256;
+    std::string index_type = "flat";
+    std::string storage = "fp32";
+    int settle_sec = 0;
+    std::string dir = "bench_memory_db";
+    uint32_t seed = 42;
+    std::string out;
+};
+
+Options parse_args(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--docs") {
+            o.docs.clear();
+            std::stringstream ss(value);
+            for (std::string n; std::getline(ss, n, ',');) o.docs.push_back(std::stoull(n));
+        } else if (flag == "--dim") o.dim = std::stoi(value);
+        else if (flag == "--queries") o.queries = std::stoi(value);
+        else if (flag == "--recall-queries") o.recall_queries = std::stoi(value);
+        else if (flag == "--k") o.k = std::stoi(value);
+        else if (flag == "--threads") o.threads = std::max(1, std::stoi(value));
+        else if (flag == "--batch") o.batch = std::max(1, std::stoi(value));
+        else if (flag == "--index-type") o.index_type = value;
+        else if (flag == "--storage") o.storage = value;
+        else if (flag == "--settle-sec") o.settle_sec = std::stoi(value);
+        else if (flag == "--dir") o.dir = value;
+        else if (flag == "--seed") o.seed = (uint32_t)std::stoul(value);
+        else if (flag == "--out") o.out = value;
+        else spdlog::warn("Unknown flag {}", flag);
+    }
+    return o;
+}
+
+// ── Synthetic corpus ─────────────────────────────────────────────────────────
+
+class Corpus {
+public:
+    Corpus(int dim, size_t topics, uint32_t seed) : dim_(dim), rng_(seed) {
+        for (size_t t = 0; t < topics; ++t) centroids_.push_back(random_unit());
+        for (int w = 0; w < 5000; ++w) vocab_.push_back("w" + std::to_string(w));
+        // Zipf(1): P(rank r) ~ 1/r.
+        double sum = 0;
+        for (size_t r = 1; r <= vocab_.size(); ++r) sum += 1.0 / r;
+        double acc = 0;
+        for (size_t r = 1; r <= vocab_.size(); ++r) {
+            acc += 1.0 / r / sum;
+            zipf_cdf_.push_back(acc);
+        }
+    }
+
+    MemoryIndex::Doc make_doc(size_t i) {
+        static const char* sources[] = {"sessions", "memory", "long-term"};
+        size_t topic = std::uniform_int_distribution<size_t>(0, centroids_.size() - 1)(rng_);
+        int day = std::uniform_int_distribution<int>(0, 729)(rng_);
+        int64_t stamp = 1704067200 + (int64_t)day * 86400; // from 2024-01-01
+        MemoryIndex::Doc doc;
+        doc.id = "d" + std::to_string(i);
+        doc.path = "memory/" + date_of(stamp) + ".md";
+        doc.start_line = (int)(i % 500);
+        doc.end_line = doc.start_line + 10;
+        doc.text = make_text(topic, 40);
+        doc.embedding = perturb(centroids_[topic], 0.6f);
+        doc.source = sources[i % 3];
+        doc.timestamp = stamp;
+        return doc;
+    }
+
+    // A query near `doc`, with a few of its words.
+    std::pair<std::string, std::vector<float>> make_query(const MemoryIndex::Doc& doc) {
+        std::stringstream ss(doc.text);
+        std::vector<std::string> words;
+        for (std::string w; ss >> w;) words.push_back(w);
+        std::string text;
+        for (int j = 0; j < 3 && !words.empty(); ++j) {
+            if (!text.empty()) text += ' ';
+            text += words[std::uniform_int_distribution<size_t>(0, words.size() - 1)(rng_)];
+        }
+        return {text, perturb(doc.embedding, 0.3f)};
+    }
+
+private:
+    std::vector<float> random_unit() {
+        std::vector<float> v(dim_);
+        for (auto& x : v) x = normal_(rng_);
+        normalize(v);
+        return v;
+    }
+
+    std::vector<float> perturb(const std::vector<float>& base, float noise) {
+        std::vector<float> v(dim_);
+        float scale = noise / std::sqrt((float)dim_);
+        for (int d = 0; d < dim_; ++d) v[d] = base[d] + scale * normal_(rng_);
+        normalize(v);
+        return v;
+    }
+
+    static void normalize(std::vector<float>& v) {
+        float n = 0;
+        for (float x : v) n += x * x;
+        n = std::sqrt(n);
+        for (auto& x : v) x /= n;
+    }
+
+    std::string make_text(size_t topic, int words) {
+        std::string text;
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        for (int j = 0; j < words; ++j) {
+            if (!text.empty()) text += ' ';
+            if (j % 4 == 0) {
+                text += "topic" + std::to_string(topic) + "_" + std::to_string(j / 4 % 5);
+            } else {
+                size_t r = std::lower_bound(zipf_cdf_.begin(), zipf_cdf_.end(), u(rng_)) - zipf_cdf_.begin();
+                text += vocab_[std::min(r, vocab_.size() - 1)];
+            }
+        }
+        return text;
+    }
+
+    static std::string date_of(int64_t stamp) {
+        time_t t = (time_t)stamp;
+        char buf[16];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%d", std::gmtime(&t));
+        return buf;
+    }
+
+    int dim_;
+    std::mt19937 rng_;
+    std::normal_distribution<float> normal_;
+    std::vector<std::vector<float>> centroids_;
+    std::vector<std::string> vocab_;
+    std::vector<double> zipf_cdf_;
+};
+
+// ── Measurement ──────────────────────────────────────────────────────────────
+
+struct Latency {
+    double qps = 0;
+    double p50 = 0, p90 = 0, p99 = 0, max = 0;
+};
+
+Latency summarize(std::vector<double> ms, double wall_ms) {
+    Latency l;
+    if (ms.empty()) return l;
+    std::sort(ms.begin(), ms.end());
+    auto pct = [&](double p) { return ms[std::min(ms.size() - 1, (size_t)(p * (ms.size() - 1) + 0.5))]; };
+    l.qps = wall_ms > 0 ? ms.size() * 1000.0 / wall_ms : 0;
+    l.p50 = pct(0.50);
+    l.p90 = pct(0.90);
+    l.p99 = pct(0.99);
+    l.max = ms.back();
+    return l;
+}
+
+// Run every query from `threads` callers at once; per-query latency in ms.
+template <typename Fn>
+Latency run_queries(size_t n, int threads, Fn&& fn) {
+    std::vector<double> ms(n);
+    std::atomic<size_t> next{0};
+    auto start = Clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() {
+            for (size_t i; (i = next++) < n;) {
+                auto q0 = Clock::now();
+                fn(i);
+                ms[i] = ms_since(q0);
+            }
+        });
+    }
+    for (auto& t : pool) t.join();
+    return summarize(std::move(ms), ms_since(start));
+}
+
+std::vector<size_t> exact_top_k(const std::vector<MemoryIndex::Doc>& docs, const std::vector<float>& q, int k) {
+    std::vector<std::pair<float, size_t>> scored(docs.size());
+    for (size_t i = 0; i < docs.size(); ++i) {
+        float s = 0;
+        for (size_t d = 0; d < q.size(); ++d) s += q[d] * docs[i].embedding[d];
+        scored[i] = {s, i};
+    }
+    size_t top = std::min(docs.size(), (size_t)k);
+    std::partial_sort(scored.begin(), scored.begin() + top, scored.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<size_t> out;
+    for (size_t i = 0; i < top; ++i) out.push_back(scored[i].second);
+    return out;
+}
+
+std::string latency_json(const Latency& l) {
+    std::ostringstream o;
+    o << "{\"qps\": " << l.qps << ", \"p50_ms\": " << l.p50 << ", \"p90_ms\": " << l.p90
+      << ", \"p99_ms\": " << l.p99 << ", \"max_ms\": " << l.max << "}";
+    return o.str();
+}
+
+std::string run_size(const Options& opt, size_t n) {
+    spdlog::info("Benchmarking {} documents (dim {}, {}, {})", n, opt.dim, opt.index_type, opt.storage);
+    std::filesystem::path dir = std::filesystem::path(opt.dir) / std::to_string(n);
+    std::filesystem::remove_all(dir);
+
+    MemoryIndexOptions mopts;
+    mopts.index_type = opt.index_type;
+    mopts.vector_storage = opt.storage;
+    mopts.search_cache_entries = 0;
+    mopts.decay_half_life_days = {{"default", 0.0}};
+    mopts.ann_min_vectors = std::min<int>(mopts.ann_min_vectors, (int)n / 2);
+
+    Corpus corpus(opt.dim, std::max<size_t>(16, (size_t)std::sqrt((double)n)), opt.seed);
+    std::vector<MemoryIndex::Doc> docs;
+    docs.reserve(n);
+    for (size_t i = 0; i < n; ++i) docs.push_back(corpus.make_doc(i));
+
+    std::ostringstream o;
+    o << "{\"docs\": " << n;
+    {
+        auto index = std::make_unique<MemoryIndex>(dir, opt.dim, mopts);
+        auto start = Clock::now();
+        for (size_t i = 0; i < n; i += opt.batch) {
+            size_t len = std::min((size_t)opt.batch, n - i);
+            index->add_documents(std::span<const MemoryIndex::Doc>(docs.data() + i, len));
+        }
+        double insert_ms = ms_since(start);
+        o << ", \"insert\": {\"ms\": " << insert_ms << ", \"docs_per_sec\": " << (insert_ms > 0 ? n * 1000.0 / insert_ms : 0) << "}";
+        if (opt.settle_sec > 0) std::this_thread::sleep_for(std::chrono::seconds(opt.settle_sec));
+    }
+
+    auto open_start = Clock::now();
+    MemoryIndex index(dir, opt.dim, mopts);
+    o << ", \"open_ms\": " << ms_since(open_start);
+    // A reopened index may start an ANN build; give it the same settle time.
+    if (opt.settle_sec > 0) std::this_thread::sleep_for(std::chrono::seconds(opt.settle_sec));
+
+    std::mt19937 rng(opt.seed + 1);
+    std::vector<std::pair<std::string, std::vector<float>>> queries;
+    for (int i = 0; i < opt.queries; ++i) {
+        queries.push_back(corpus.make_query(docs[std::uniform_int_distribution<size_t>(0, n - 1)(rng)]));
+    }
+
+    // Ground truth for the first --recall-queries queries, off the clock.
+    size_t recall_n = std::min(queries.size(), (size_t)opt.recall_queries);
+    std::vector<std::vector<size_t>> truth(recall_n);
+    run_queries(recall_n, (int)std::max(1u, std::thread::hardware_concurrency()), [&](size_t i) {
+        truth[i] = exact_top_k(docs, queries[i].second, opt.k);
+    });
+
+    std::vector<double> recall(recall_n);
+    Latency vector_only = run_queries(queries.size(), opt.threads, [&](size_t i) {
+        auto results = index.search("", queries[i].second, opt.k);
+        if (i >= recall_n) return;
+        std::unordered_set<std::string> want;
+        for (size_t t : truth[i]) want.insert(docs[t].id);
+        size_t hit = 0;
+        for (const auto& r : results) hit += want.count(r.id);
+        recall[i] = truth[i].empty() ? 1.0 : (double)hit / truth[i].size();
+    });
+    Latency hybrid = run_queries(queries.size(), opt.threads, [&](size_t i) {
+        index.search(queries[i].first, queries[i].second, opt.k);
+    });
+    Latency keyword = run_queries(queries.size(), opt.threads, [&](size_t i) {
+        index.search(queries[i].first, {}, opt.k);
+    });
+
+    double mean_recall = 0;
+    for (double r : recall) mean_recall += r;
+    mean_recall /= std::max<size_t>(1, recall.size());
+
+    o << ", \"recall_at_k\": " << mean_recall
+      << ", \"vector_search\": " << latency_json(vector_only)
+      << ", \"hybrid_search\": " << latency_json(hybrid)
+      << ", \"keyword_search\": " << latency_json(keyword) << "}";
+    spdlog::info("{} docs: recall@{} {:.4f}, vector p50 {:.3f} ms p99 {:.3f} ms, hybrid p50 {:.3f} ms p99 {:.3f} ms",
+                 n, opt.k, mean_recall, vector_only.p50, vector_only.p99, hybrid.p50, hybrid.p99);
+    return o.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    spdlog::set_level(spdlog::level::info);
+    Options opt = parse_args(argc, argv);
+
+    std::ostringstream o;
+    o << "{\"benchmark\": \"memory_index\""
+#ifdef USE_SQLITE
+      << ", \"keyword_backend\": \"sqlite\""
+#else
+      << ", \"keyword_backend\": \"lucene\""
+#endif
+      << ", \"index_type\": \"" << json_util::escape(opt.index_type) << "\""
+      << ", \"vector_storage\": \"" << json_util::escape(opt.storage) << "\""
+      << ", \"dim\": " << opt.dim << ", \"k\": " << opt.k << ", \"queries\": " << opt.queries
+      << ", \"recall_queries\": " << opt.recall_queries
+      << ", \"threads\": " << opt.threads << ", \"batch\": " << opt.batch << ", \"seed\": " << opt.seed
+      << ", \"results\": [";
+    for (size_t i = 0; i < opt.docs.size(); ++i) {
+        if (i) o << ", ";
+        o << run_size(opt, opt.docs[i]);
+    }
+    o << "]}\n";
+
+    if (opt.out.empty()) {
+        std::cout << o.str();
+    } else {
+        std::ofstream(opt.out) << o.str();
+        spdlog::info("Wrote {}", opt.out);
+    }
+    std::filesystem::remove_all(opt.dir);
+    return 0;
+}
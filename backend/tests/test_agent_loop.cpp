@@ -4,11 +4,13 @@
 #include "agent/loop.hpp"
 #include "tools/file.hpp"
 #include "agent/fiber_pool.hpp"
+#include "agent/sse_parser.hpp"
 
 // Mock FiberNode for tests (no real fiber infrastructure)
 thread_local FiberNode* g_current_node = nullptr;
 FiberNode* FiberNode::current() { return nullptr; }
 void FiberNode::spawn(std::function<void()> task) {}
+void FiberNode::spawn_back_on_loop(std::function<void()> task) {}
 
 // Mock LLM: on first call returns a native tool_call (write_file),
 // on second call returns the final answer.
@@ -72,5 +74,35 @@ int main() {
     // Cleanup
     std::filesystem::remove("test_tool_use.txt");
 
+    std::cout << "Running SSE Framing Test..." << std::endl;
+    {
+        const std::string stream =
+            ": keep-alive\r\n"
+            "data: {\"a\":1}\r\n\r\n"
+            "event: error\n"
+            "data:first\n"
+            "data: second\n\n"
+            "data: {\"b\":2}\r\r"
+            "event: ignored\n\n"
+            "data: [DONE]";
+        // Fed whole and one byte at a time, the stream frames the same way.
+        for (size_t step : {stream.size(), (size_t)1}) {
+            std::vector<std::pair<std::string, std::string>> events;
+            SseParser sse([&](std::string_view type, std::string_view data) {
+                events.emplace_back(std::string(type), std::string(data));
+            });
+            for (size_t i = 0; i < stream.size(); i += step) {
+                sse.feed(stream.data() + i, std::min(step, stream.size() - i));
+            }
+            sse.finish();
+            assert(events.size() == 4);
+            assert(events[0] == std::make_pair(std::string("message"), std::string("{\"a\":1}")));
+            assert(events[1] == std::make_pair(std::string("error"), std::string("first\nsecond")));
+            assert(events[2] == std::make_pair(std::string("message"), std::string("{\"b\":2}")));
+            assert(events[3] == std::make_pair(std::string("message"), std::string("[DONE]")));
+        }
+    }
+    std::cout << "✅ SSE Framing Test PASSED!" << std::endl;
+
     return 0;
 }
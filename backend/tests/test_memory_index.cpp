@@ -1,14 +1,47 @@
 #include <iostream>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <thread>
 #include "../src/agent/memory_index.hpp"
 #include "../src/agent/fiber_pool.hpp"
+#include "../src/agent/ingest.hpp"
+#include "../src/agent/index_queue.hpp"
+#include "../src/agent/embedding_cache.hpp"
+#include "../src/agent/static_embedder.hpp"
+#include "../src/agent/base64_floats.hpp"
+#include "../src/agent/vector_file.hpp"
 #include <spdlog/spdlog.h>
 
 // Mock FiberNode for tests
 FiberNode* FiberNode::current() { return nullptr; }
 void FiberNode::spawn(std::function<void()> task) {}
+void FiberNode::spawn_back_on_loop(std::function<void()> task) {}
+
+static std::vector<float> normalized(std::vector<float> v) {
+    float norm = 0.0f;
+    for (float x : v) norm += x * x;
+    for (auto& x : v) x /= std::sqrt(norm);
+    return v;
+}
+
+static std::vector<float> random_unit(std::mt19937& rng, int dim) {
+    std::normal_distribution<float> dist;
+    std::vector<float> v(dim);
+    for (auto& x : v) x = dist(rng);
+    return normalized(std::move(v));
+}
 
 int main() {
     spdlog::set_level(spdlog::level::debug);
@@ -57,6 +90,606 @@ int main() {
     assert(results3[0].id == doc2_id);
     spdlog::info("Hybrid search successful: found {} for query 'programming'", results3[0].id);
 
+    spdlog::info("Testing HNSW index with background build...");
+    {
+        const std::string ann_db = "test_memory_db_hnsw";
+        std::filesystem::remove_all(ann_db);
+        MemoryIndexOptions opts;
+        opts.index_type = "hnsw";
+        opts.ann_min_vectors = 256;
+        const int ann_dim = 32;
+        MemoryIndex ann_index(std::filesystem::path(ann_db), ann_dim, opts);
+
+        std::mt19937 rng(42);
+        std::vector<std::vector<float>> vecs;
+        std::vector<MemoryIndex::Doc> docs;
+        for (int i = 0; i < 300; ++i) {
+            std::vector<float> v = random_unit(rng, ann_dim);
+            vecs.push_back(v);
+            docs.push_back({"ann" + std::to_string(i), "ann.txt", i, i, "vector " + std::to_string(i), v, "memory"});
+        }
+        ann_index.add_documents(docs);
+
+        // Whether or not the HNSW swap has happened yet, the exact match must rank first.
+        auto r = ann_index.search("", vecs[123], 3);
+        assert(!r.empty() && r[0].id == "ann123");
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        r = ann_index.search("", vecs[7], 3);
+        assert(!r.empty() && r[0].id == "ann7");
+    }
+    spdlog::info("HNSW search successful");
+
+    spdlog::info("Testing searches concurrent with adds...");
+    {
+        const std::string rw_db = "test_memory_db_concurrent";
+        std::filesystem::remove_all(rw_db);
+        const int rw_dim = 16;
+        MemoryIndex rw_index(std::filesystem::path(rw_db), rw_dim, MemoryIndexOptions{});
+
+        std::vector<float> probe(rw_dim, 0.0f);
+        probe[0] = 1.0f;
+        rw_index.add_document("probe", "probe.md", 1, 1, "probe document", probe, "memory");
+
+        std::thread writer([&]() {
+            for (int i = 0; i < 200; ++i) {
+                std::vector<float> v(rw_dim, 0.0f);
+                v[1 + i % (rw_dim - 1)] = 1.0f;
+                rw_index.add_document("w" + std::to_string(i), "w.md", i, i, "filler " + std::to_string(i), v, "sessions");
+            }
+        });
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&]() {
+                for (int i = 0; i < 50; ++i) {
+                    auto r = rw_index.search("probe", probe, 3);
+                    assert(!r.empty() && r[0].id == "probe");
+                }
+            });
+        }
+        writer.join();
+        for (auto& t : readers) t.join();
+    }
+    spdlog::info("Concurrent search successful");
+
+    spdlog::info("Testing search cache and singleflight...");
+    {
+        const std::string c_db = "test_memory_db_cache";
+        std::filesystem::remove_all(c_db);
+        const int c_dim = 8;
+        MemoryIndex c_index(std::filesystem::path(c_db), c_dim, MemoryIndexOptions{});
+        std::vector<float> v(c_dim, 0.0f);
+        v[0] = 1.0f;
+        c_index.add_document("first", "a.md", 0, 0, "cached answer", v, "memory");
+
+        std::atomic<int> embeds{0};
+        auto embed = [&]() {
+            ++embeds;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            return v;
+        };
+        // Four identical searches at once run once; the rest join it.
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&]() {
+                auto r = c_index.search_query("Cached answer", embed, 5);
+                assert(r.size() == 1 && r[0].id == "first");
+            });
+        }
+        for (auto& t : threads) t.join();
+        assert(embeds == 1);
+
+        // Spacing does not matter, case does; a write invalidates.
+        auto r = c_index.search_query("  Cached   answer ", embed, 5);
+        assert(r.size() == 1 && embeds == 1);
+        r = c_index.search_query("cached ANSWER", embed, 5);
+        assert(r.size() == 1 && embeds == 2);
+        c_index.add_document("second", "b.md", 0, 0, "another cached answer", v, "memory");
+        r = c_index.search_query("Cached answer", embed, 5);
+        assert(r.size() == 2 && embeds == 3);
+    }
+    spdlog::info("Search cache successful");
+
+    spdlog::info("Testing temporal decay...");
+    {
+        const std::string decay_db = "test_memory_db_decay";
+        std::filesystem::remove_all(decay_db);
+        const int decay_dim = 8;
+        MemoryIndex decay_index(std::filesystem::path(decay_db), decay_dim, MemoryIndexOptions{});
+
+        std::vector<float> v(decay_dim, 0.0f);
+        v[0] = 1.0f;
+        // Same embedding; only the old daily log's path date should lower its score.
+        decay_index.add_document("old", "memory/2020-01-01.md", 0, 0, "old daily log", v, "memory");
+        decay_index.add_document("fact", "MEMORY.md", 0, 0, "permanent fact", v, "long-term");
+        auto r = decay_index.search("", v, 2);
+        assert(r.size() == 2 && r[0].id == "fact" && r[1].id == "old");
+        assert(r[1].timestamp == 1577836800 && r[1].score < 0.01f);
+    }
+    spdlog::info("Temporal decay successful");
+
+    spdlog::info("Testing sharded decayed search...");
+    {
+        const std::string sh_db = "test_memory_db_shards";
+        std::filesystem::remove_all(sh_db);
+        const int sh_dim = 16;
+        std::mt19937 rng(5);
+        std::vector<float> q = random_unit(rng, sh_dim);
+
+        // Two years of monthly logs, each holding an exact match for q.
+        std::vector<MemoryIndex::Doc> docs;
+        for (int m = 0; m < 24; ++m) {
+            char date[16];
+            std::snprintf(date, sizeof(date), "%04d-%02d-15", 2022 + m / 12, m % 12 + 1);
+            std::string path = std::string("memory/") + date + ".md";
+            docs.push_back({"exact" + std::to_string(m), path, 0, 0, "old match", q, "memory"});
+            for (int i = 0; i < 5; ++i) docs.push_back({"noise" + std::to_string(m * 5 + i), path, 0, 0, "noise", random_unit(rng, sh_dim), "memory"});
+        }
+        // Today's entry is only a partial match, but it has not decayed.
+        std::vector<float> recent = q;
+        for (auto& x : recent) x *= 0.6f;
+        recent[0] += 0.3f;
+        docs.push_back({"recent", "memory/today.md", 0, 0, "recent note", recent, "memory", (int64_t)std::time(nullptr)});
+        docs.push_back({"undated", "notes.md", 0, 0, "undated note", q, "memory"});
+
+        MemoryIndex sh_index(std::filesystem::path(sh_db), sh_dim, MemoryIndexOptions{});
+        sh_index.add_documents(docs);
+        auto r = sh_index.search("", q, 3);
+        assert(r.size() >= 2 && r[0].id == "undated" && r[1].id == "recent");
+        assert(r.size() < 3 || r[2].id == "exact23"); // the newest of the old months
+
+        SearchFilter f;
+        f.path_prefix = "memory/2022-";
+        r = sh_index.search("", q, 1, f);
+        assert(r.size() == 1 && r[0].id == "exact11");
+
+        sh_index.remove_document("undated");
+        r = sh_index.search("", q, 1);
+        assert(r.size() == 1 && r[0].id == "recent");
+    }
+    spdlog::info("Sharded search successful");
+
+    spdlog::info("Testing upsert, remove and compaction...");
+    {
+        const std::string up_db = "test_memory_db_upsert";
+        std::filesystem::remove_all(up_db);
+        const int up_dim = 8;
+        MemoryIndexOptions opts;
+        opts.compact_min_tombstones = 4;
+        opts.compact_tombstone_ratio = 0.5;
+        auto unit = [&](int axis) {
+            std::vector<float> v(up_dim, 0.0f);
+            v[axis % up_dim] = 1.0f;
+            return v;
+        };
+        {
+            MemoryIndex up_index(std::filesystem::path(up_db), up_dim, opts);
+            up_index.add_document("keep", "keep.md", 0, 0, "kept note", unit(1), "memory");
+            for (int i = 0; i < 6; ++i) {
+                up_index.upsert_document("L3", "MEMORY.md", 0, 0, "facts version " + std::to_string(i), unit(0), "long-term");
+            }
+            auto r = up_index.search("facts", unit(0), 5);
+            assert(!r.empty() && r[0].id == "L3" && r[0].text == "facts version 5");
+            assert(std::count_if(r.begin(), r.end(), [](const SearchResult& hit) { return hit.id == "L3"; }) == 1);
+
+            up_index.remove_document("keep");
+            r = up_index.search("kept", unit(1), 5);
+            for (const auto& hit : r) assert(hit.id != "keep");
+
+            // Six tombstones out of seven rows crosses the threshold; wait for
+            // the background rebuild to swap in the smaller vector file.
+            auto vectors = std::filesystem::path(up_db) / "vectors.f32";
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+            while (std::filesystem::file_size(vectors) >= 64 + 7 * up_dim * sizeof(float)) {
+                assert(std::chrono::steady_clock::now() < deadline);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            up_index.add_document("late", "late.md", 0, 0, "late note", unit(2), "memory");
+        }
+        MemoryIndex reopened(std::filesystem::path(up_db), up_dim, opts);
+        auto r = reopened.search("", unit(0), 5);
+        assert(!r.empty() && r[0].id == "L3" && r[0].text == "facts version 5");
+        r = reopened.search("", unit(2), 1);
+        assert(r.size() == 1 && r[0].id == "late");
+        // Compaction dropped tombstoned rows: fewer than the eight ever added.
+        assert(std::filesystem::file_size(std::filesystem::path(up_db) / "vectors.f32") < 64 + 8 * up_dim * sizeof(float));
+    }
+    spdlog::info("Upsert and compaction successful");
+
+    spdlog::info("Testing SQ8 storage with exact re-ranking...");
+    {
+        const std::string sq_db = "test_memory_db_sq8";
+        std::filesystem::remove_all(sq_db);
+        MemoryIndexOptions opts;
+        opts.vector_storage = "sq8";
+        const int sq_dim = 32;
+
+        std::mt19937 rng(7);
+        std::vector<MemoryIndex::Doc> docs;
+        for (int i = 0; i < 200; ++i) {
+            std::vector<float> v = random_unit(rng, sq_dim);
+            docs.push_back({"sq" + std::to_string(i), "sq.txt", i, i, "vector " + std::to_string(i), v, "memory"});
+        }
+        {
+            MemoryIndex sq_index(std::filesystem::path(sq_db), sq_dim, opts);
+            sq_index.add_documents(docs);
+            for (int i = 0; i < 200; i += 17) {
+                auto r = sq_index.search("", docs[i].embedding, 3);
+                assert(!r.empty() && r[0].id == docs[i].id);
+            }
+        }
+        assert(std::filesystem::file_size(std::filesystem::path(sq_db) / "vectors.f32") == 64 + 200 * sq_dim * sizeof(float));
+        MemoryIndex reopened(std::filesystem::path(sq_db), sq_dim, opts);
+        auto r = reopened.search("", docs[42].embedding, 3);
+        assert(!r.empty() && r[0].id == "sq42");
+    }
+    spdlog::info("SQ8 search successful");
+
+    spdlog::info("Testing mapped fp32 storage and shared open...");
+    {
+        const std::string m_db = "test_memory_db_mapped";
+        std::filesystem::remove_all(m_db);
+        const int m_dim = 16;
+        std::mt19937 rng(11);
+        std::vector<MemoryIndex::Doc> docs;
+        for (int i = 0; i < 50; ++i) {
+            std::vector<float> v = random_unit(rng, m_dim);
+            docs.push_back({"m" + std::to_string(i), "m.txt", i, i, "mapped " + std::to_string(i), v, "memory"});
+        }
+        {
+            auto a = MemoryIndex::open_shared(std::filesystem::path(m_db), m_dim, MemoryIndexOptions{});
+            auto b = MemoryIndex::open_shared(std::filesystem::path(m_db) / ".", m_dim, MemoryIndexOptions{});
+            assert(a == b);
+            a->add_documents(docs);
+            auto r = b->search("", docs[7].embedding, 1);
+            assert(r.size() == 1 && r[0].id == "m7");
+        }
+        // The vector file is the index: no faiss.index snapshot is written.
+        assert(!std::filesystem::exists(std::filesystem::path(m_db) / "faiss.index"));
+        assert(std::filesystem::file_size(std::filesystem::path(m_db) / "vectors.f32") == 64 + 50 * m_dim * sizeof(float));
+        // ...and the rows are not logged a second time.
+        assert(std::filesystem::file_size(std::filesystem::path(m_db) / "faiss.wal") == 0);
+#ifdef USE_SQLITE
+        // Nor is the text: meta.blob points into the documents table.
+        {
+            std::ifstream blob(std::filesystem::path(m_db) / "meta.blob", std::ios::binary);
+            std::string bytes((std::istreambuf_iterator<char>(blob)), std::istreambuf_iterator<char>());
+            assert(!bytes.empty() && bytes.find("mapped 33") == std::string::npos);
+        }
+#endif
+
+        // A crash after a vector landed but before its metadata: the row is dropped.
+        std::vector<float> stray = random_unit(rng, m_dim);
+        {
+            std::ofstream out(std::filesystem::path(m_db) / "vectors.f32", std::ios::binary | std::ios::app);
+            out.write(reinterpret_cast<const char*>(stray.data()), m_dim * sizeof(float));
+        }
+        auto reopened = MemoryIndex::open_shared(std::filesystem::path(m_db), m_dim, MemoryIndexOptions{});
+        auto r = reopened->search("", docs[33].embedding, 1);
+        assert(r.size() == 1 && r[0].id == "m33" && r[0].text == "mapped 33");
+        r = reopened->search("", stray, 50);
+        assert(r.size() == 50);
+        for (const auto& hit : r) assert(!hit.id.empty());
+    }
+    {
+        // A vector file without a valid header starts afresh instead of being read as rows.
+        const std::string v_db = "test_memory_db_vectorfile";
+        std::filesystem::remove_all(v_db);
+        std::filesystem::create_directories(v_db);
+        auto path = std::filesystem::path(v_db) / "vectors.f32";
+        {
+            std::ofstream out(path, std::ios::binary);
+            std::string junk(64 + 3 * 4 * sizeof(float), 'x');
+            out.write(junk.data(), (std::streamsize)junk.size());
+        }
+        VectorFile vf(path, 4);
+        assert(vf.size() == 0 && std::filesystem::file_size(path) == 64);
+    }
+    spdlog::info("Mapped storage successful");
+
+    spdlog::info("Testing filtered search...");
+    {
+        const std::string f_db = "test_memory_db_filter";
+        std::filesystem::remove_all(f_db);
+        const int f_dim = 8;
+        MemoryIndex f_index(std::filesystem::path(f_db), f_dim, MemoryIndexOptions{});
+
+        std::vector<float> v(f_dim, 0.0f);
+        v[0] = 1.0f;
+        std::vector<MemoryIndex::Doc> docs = {
+            {"a1", "session:alpha", 0, 0, "[user] deploy the server", v, "sessions", 1700000000},
+            {"b1", "session:beta", 0, 0, "[user] deploy the client", v, "sessions", 1700000000},
+            {"log", "memory/2024-03-05.md", 0, 0, "deploy notes", v, "memory"},
+            {"fact", "MEMORY.md", 0, 0, "deploy target is prod", v, "long-term"},
+        };
+        f_index.add_documents(docs);
+
+        auto ids = [](const std::vector<SearchResult>& r) {
+            std::vector<std::string> out;
+            for (const auto& hit : r) out.push_back(hit.id);
+            std::sort(out.begin(), out.end());
+            return out;
+        };
+        SearchFilter session;
+        session.session = "alpha";
+        assert(ids(f_index.search("deploy", v, 10, session)) == std::vector<std::string>{"a1"});
+        assert(ids(f_index.search("", v, 10, session)) == std::vector<std::string>{"a1"});
+
+        SearchFilter sources;
+        sources.sources = {"memory", "long-term"};
+        assert(ids(f_index.search("deploy", v, 10, sources)) == (std::vector<std::string>{"fact", "log"}));
+        assert(ids(f_index.search("deploy", {}, 10, sources)) == (std::vector<std::string>{"fact", "log"}));
+
+        SearchFilter dated;
+        dated.since = date_from_path("2024-01-01");
+        assert(ids(f_index.search("deploy", v, 10, dated)) == std::vector<std::string>{"log"});
+        assert(ids(f_index.search("deploy", {}, 10, dated)) == std::vector<std::string>{"log"});
+
+        SearchFilter prefix;
+        prefix.path_prefix = "session:";
+        prefix.until = date_from_path("2024-01-01");
+        assert(ids(f_index.search("deploy", v, 10, prefix)) == (std::vector<std::string>{"a1", "b1"}));
+    }
+    spdlog::info("Filtered search successful");
+
+    spdlog::info("Testing document chunking and path replacement...");
+    {
+        std::string text;
+        for (int i = 1; i <= 100; ++i) text += "line " + std::to_string(i) + " of the design notes\n";
+        text += "the rollback plan lives on line 101\n";
+        auto chunks = chunk_lines(text, 300, 60);
+        assert(chunks.size() > 5);
+        assert(chunks.front().start_line == 1 && chunks.back().end_line == 101);
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            const auto& c = chunks[i];
+            assert(c.text.size() <= 300);
+            assert(c.text.rfind("line " + std::to_string(c.start_line) + " ", 0) == 0);
+            if (i > 0) {
+                // Overlapping, but always advancing.
+                assert(c.start_line > chunks[i - 1].start_line && c.start_line <= chunks[i - 1].end_line);
+            }
+        }
+        auto long_line = chunk_lines(std::string(1000, 'x'), 300, 60);
+        assert(long_line.size() == 4 && long_line[3].start_line == 1 && long_line[3].end_line == 1);
+
+        const std::string d_db = "test_memory_db_ingest";
+        std::filesystem::remove_all(d_db);
+        const int d_dim = 8;
+        MemoryIndex d_index(std::filesystem::path(d_db), d_dim, MemoryIndexOptions{});
+        auto to_docs = [&](const std::vector<Chunk>& cs) {
+            std::vector<std::string> texts;
+            for (const auto& c : cs) texts.push_back(c.text);
+            auto embs = embed_concurrently([&](const std::string& t) {
+                std::vector<float> v(d_dim, 0.0f);
+                v[t.size() % d_dim] = 1.0f;
+                return v;
+            }, texts, 4);
+            std::vector<MemoryIndex::Doc> docs;
+            for (size_t i = 0; i < cs.size(); ++i) {
+                docs.push_back({"DOC_notes.md#" + std::to_string(i), "notes.md", cs[i].start_line, cs[i].end_line, cs[i].text, embs[i], "memory"});
+            }
+            return docs;
+        };
+        auto docs = to_docs(chunks);
+        d_index.replace_path("notes.md", docs);
+        auto r = d_index.search("rollback", {}, 3);
+        assert(!r.empty() && r[0].path == "notes.md" && r[0].end_line == 101 && r[0].start_line > 90);
+
+        // Re-indexing the path drops every old chunk, vector and keyword.
+        auto edited = chunk_lines("a short replacement\n", 300, 60);
+        docs = to_docs(edited);
+        d_index.replace_path("notes.md", docs);
+        assert(d_index.search("rollback", {}, 3).empty());
+        std::vector<float> probe(d_dim, 0.0f);
+        probe[edited[0].text.size() % d_dim] = 1.0f;
+        r = d_index.search("", probe, 10);
+        assert(r.size() == 1 && r[0].text == "a short replacement");
+
+        // Only that path's rows go.
+        d_index.add_document("other", "other.md", 0, 0, "another file", probe, "memory");
+        d_index.replace_path("notes.md", docs);
+        r = d_index.search("", probe, 10);
+        assert(r.size() == 2);
+        d_index.replace_path("notes.md", {});
+        r = d_index.search("", probe, 10);
+        assert(r.size() == 1 && r[0].id == "other");
+    }
+    spdlog::info("Document ingestion successful");
+
+    spdlog::info("Testing re-embedding after an embedding change...");
+    {
+        const std::string e_db = "test_memory_db_reembed";
+        std::filesystem::remove_all(e_db);
+        auto embed_as = [](const std::string& text, int dim) {
+            std::vector<float> v(dim);
+            size_t h = std::hash<std::string>{}(text);
+            for (int j = 0; j < dim; ++j) v[j] = std::sin((float)(h % 1000) * 0.37f * (j + 1)) + 0.01f * j;
+            return normalized(std::move(v));
+        };
+        MemoryIndexOptions model_a;
+        model_a.embedding_model = "model-a";
+        {
+            MemoryIndex idx(std::filesystem::path(e_db), 4, model_a);
+            for (int i = 0; i < 10; ++i) {
+                std::string text = "reembed note " + std::to_string(i);
+                idx.add_document("R" + std::to_string(i), "notes.md", i, i, text, embed_as(text, 4), "memory");
+            }
+            idx.add_document("R_plain", "notes.md", 0, 0, "reembed keyword only", {}, "memory");
+            idx.remove_document("R3");
+            assert(!idx.reembed_pending());
+        }
+
+        MemoryIndexOptions model_b;
+        model_b.embedding_model = "model-b";
+        {
+            MemoryIndex idx(std::filesystem::path(e_db), 6, model_b);
+            assert(idx.reembed_pending());
+            // Until re-embedded, documents are found by keyword only.
+            assert(idx.search("", embed_as("reembed note 5", 6), 5).empty());
+            assert(!idx.search("reembed", {}, 20).empty());
+
+            // Written after the change, so it already has a vector.
+            idx.add_document("R_new", "notes.md", 0, 0, "reembed fresh", embed_as("reembed fresh", 6), "memory");
+
+            // Two notes fail to embed: the pass ends, but they stay pending.
+            std::set<std::string> failing = {"reembed note 2", "reembed note 7"};
+            std::atomic<int> calls{0};
+            auto embed = [&](const std::vector<std::string>& texts) {
+                ++calls;
+                assert(texts.size() <= 3);
+                std::vector<std::vector<float>> out;
+                for (const auto& t : texts) out.push_back(failing.count(t) ? std::vector<float>{} : embed_as(t, 6));
+                return out;
+            };
+            size_t done = idx.reembed(embed, 3, 0);
+            assert(done == 8); // nine notes (R3 was removed) and the keyword-only document, less two
+            assert(calls == 4);
+            assert(idx.reembed_pending());
+            auto r = idx.search("", embed_as("reembed note 7", 6), 20);
+            assert(std::none_of(r.begin(), r.end(), [](const SearchResult& x) { return x.id == "R7"; }));
+        }
+        {
+            // The marker survives a restart, and the next pass fills the gaps.
+            MemoryIndex idx(std::filesystem::path(e_db), 6, model_b);
+            assert(idx.reembed_pending());
+            std::atomic<int> calls{0};
+            size_t done = idx.reembed([&](const std::vector<std::string>& texts) {
+                ++calls;
+                std::vector<std::vector<float>> out;
+                for (const auto& t : texts) out.push_back(embed_as(t, 6));
+                return out;
+            }, 3, 0);
+            assert(done == 2);
+            assert(calls == 1);
+            assert(!idx.reembed_pending());
+
+            auto r = idx.search("", embed_as("reembed note 5", 6), 20);
+            assert(!r.empty() && r[0].id == "R5");
+            assert(std::none_of(r.begin(), r.end(), [](const SearchResult& x) { return x.id == "R3"; }));
+            assert(std::count_if(r.begin(), r.end(), [](const SearchResult& x) { return x.id == "R_new"; }) == 1);
+            r = idx.search("", embed_as("reembed note 7", 6), 1);
+            assert(!r.empty() && r[0].id == "R7");
+            assert(idx.reembed([](const std::vector<std::string>&) { return std::vector<std::vector<float>>{}; }) == 0);
+        }
+        {
+            // The new vectors persist, and nothing is pending on reopen.
+            MemoryIndex idx(std::filesystem::path(e_db), 6, model_b);
+            assert(!idx.reembed_pending());
+            auto r = idx.search("", embed_as("reembed keyword only", 6), 1);
+            assert(!r.empty() && r[0].id == "R_plain");
+        }
+    }
+    spdlog::info("Re-embedding successful");
+
+    spdlog::info("Testing the write-behind queue off a fiber...");
+    {
+        const std::string q_db = "test_memory_db_queue";
+        std::filesystem::remove_all(q_db);
+        auto q_index = std::make_shared<MemoryIndex>(std::filesystem::path(q_db), 4, MemoryIndexOptions{});
+        auto queue = std::make_shared<IndexQueue>(q_index, nullptr, 8, 4, 2);
+        // Without a fiber to drain it the queue refuses, leaving the document to the caller.
+        MemoryIndex::Doc doc{"Q1", "session:q", 0, 0, "queued text", {}, "sessions", 0};
+        assert(!queue->push(std::move(doc)));
+        assert(doc.id == "Q1" && doc.text == "queued text");
+        assert(queue->size() == 0);
+        queue->flush();
+    }
+    spdlog::info("Write-behind queue successful");
+
+    spdlog::info("Testing the embedding cache...");
+    {
+        const std::filesystem::path c_path = "test_memory_db_cache/embeddings.bin";
+        std::filesystem::remove_all(c_path.parent_path());
+        std::vector<float> v{0.5f, -0.5f, 0.5f, -0.5f};
+        std::vector<float> out;
+        {
+            EmbeddingCache cache(c_path, "model-a", 4, 2, 1 << 20);
+            assert(!cache.get("hello", out));
+            cache.put("hello", v);
+            cache.put("short", {1.0f}); // wrong dimension: not kept
+            assert(cache.get("hello", out) && out == v);
+            assert(!cache.get("hello ", out) && !cache.get("short", out));
+            for (int i = 0; i < 5; ++i) cache.put("text " + std::to_string(i), v); // pushes "hello" out of memory
+            assert(cache.get("hello", out) && out == v); // read back from the file
+            assert(cache.size() == 6);
+        }
+        {
+            EmbeddingCache cache(c_path, "model-a", 4, 2, 1 << 20);
+            assert(cache.size() == 6 && cache.get("text 3", out) && out == v);
+        }
+        {
+            // Another model starts afresh, and so does a full file.
+            EmbeddingCache cache(c_path, "model-b", 4, 2, 64 + 2 * (16 + 16));
+            assert(cache.size() == 0 && !cache.get("hello", out));
+            cache.put("one", v);
+            cache.put("two", v);
+            cache.put("three", v);
+            assert(cache.size() == 1);
+        }
+    }
+    spdlog::info("Embedding cache successful");
+
+    spdlog::info("Testing the static embedder...");
+    {
+        const std::filesystem::path m_dir = "test_memory_db_static";
+        std::filesystem::remove_all(m_dir);
+        std::filesystem::create_directories(m_dir);
+        {
+            std::ofstream tok(m_dir / "tokenizer.json");
+            tok << R"({"normalizer": {"type": "BertNormalizer", "lowercase": true},
+                      "model": {"type": "WordPiece", "unk_token": "[UNK]", "continuing_subword_prefix": "##",
+                                "vocab": {"[UNK]": 0, "hello": 1, "world": 2, "##s": 3, ",": 4}}})";
+        }
+        {
+            // Five tokens x 3 dimensions; token i is (i, 1, -1).
+            std::string header = R"({"embeddings":{"dtype":"F32","shape":[5,3],"data_offsets":[0,60]}})";
+            header.resize((header.size() + 7) / 8 * 8, ' ');
+            uint64_t len = header.size();
+            std::ofstream st(m_dir / "model.safetensors", std::ios::binary);
+            st.write(reinterpret_cast<const char*>(&len), sizeof(len));
+            st << header;
+            for (int i = 0; i < 5; ++i) {
+                float row[3] = {(float)i, 1.0f, -1.0f};
+                st.write(reinterpret_cast<const char*>(row), sizeof(row));
+            }
+        }
+
+        StaticEmbedder embedder;
+        assert(!embedder.load(m_dir, 4)); // more dimensions than the table has
+        assert(embedder.load(m_dir, 2));
+        assert((embedder.tokenize("Hello, Worlds zzz") == std::vector<int>{1, 4, 2, 3}));
+
+        // (1+4+2+3, 4) truncated to 2 dimensions, normalized.
+        std::vector<float> v = embedder.embed("Hello, Worlds zzz");
+        assert(v.size() == 2);
+        float n = std::sqrt(10.0f * 10.0f + 4.0f * 4.0f);
+        assert(std::abs(v[0] - 10.0f / n) < 1e-5f && std::abs(v[1] - 4.0f / n) < 1e-5f);
+        assert(embedder.embed("zzz ?!").empty()); // no known token
+    }
+    spdlog::info("Static embedder successful");
+
+    spdlog::info("Testing base64 embedding decoding...");
+    {
+        const std::string packed = "AACAPwAAAMAAAAA/AABAQAAAgEA="; // {1, -2, 0.5, 3, 4}
+        assert(base64_float_count(packed) == 5);
+        float out[5] = {};
+        double sum_sq = 0;
+        assert(decode_base64_floats(packed, out, 5, sum_sq) == 5);
+        assert(out[0] == 1.0f && out[1] == -2.0f && out[2] == 0.5f && out[3] == 3.0f && out[4] == 4.0f);
+        assert(sum_sq == 1 + 4 + 0.25 + 9 + 16);
+
+        float head[4] = {};
+        assert(decode_base64_floats(packed, head, 4, sum_sq) == 4); // truncated
+        assert(head[3] == 3.0f && sum_sq == 1 + 4 + 0.25 + 9);
+        assert(decode_base64_floats(packed, head, 1, sum_sq) == 1 && head[0] == 1.0f && sum_sq == 1);
+
+        assert(decode_base64_floats("AACA*wAAAMA=", head, 2, sum_sq) == 0); // invalid character
+        assert(decode_base64_floats("AACAP=AAAMA=", head, 2, sum_sq) == 0); // padding mid-string
+        assert(base64_float_count("AB=A") == 0 && decode_base64_floats("AB=AAAAA", head, 1, sum_sq) == 0);
+        assert(decode_base64_floats("AACAPwAAAMA=", head, 2, sum_sq) == 2 && head[1] == -2.0f);
+        assert(base64_float_count("AACAP") == 0);
+    }
+    spdlog::info("Base64 decoding successful");
+
     spdlog::info("MemoryIndex test PASSED!");
     return 0;
 }